@@ -0,0 +1,43 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef EXTRAS_BENCHMARK_ARDUINO_HOST
+#define EXTRAS_BENCHMARK_ARDUINO_HOST
+
+// Arduino functions and module list globals (Totem.cpp) required by lib/ and api/
+// headers on host. Include in single translation unit before library headers.
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+
+inline unsigned long millis() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+inline void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#include "lib/ModuleList.h"
+
+namespace TotemLib {
+
+static ModuleList detachedModuleList(nullptr);
+static ModuleList *defaultModuleList = &detachedModuleList;
+ModuleList& getDefaultModuleList() {
+    return *defaultModuleList;
+}
+ModuleList& getDetachedModuleList() {
+    return detachedModuleList;
+}
+void setDefaultModuleList(ModuleList &list) {
+    defaultModuleList = &list;
+}
+
+} // namespace TotemLib
+
+#endif /* EXTRAS_BENCHMARK_ARDUINO_HOST */
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef EXTRAS_BENCHMARK_BENCH
+#define EXTRAS_BENCHMARK_BENCH
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+namespace Bench {
+
+struct Result {
+    uint64_t messages = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+// Run function until "minSeconds" elapsed. Function returns processed Result for one round
+template <typename Function>
+Result run(Function func, double minSeconds = 0.2) {
+    using Clock = std::chrono::steady_clock;
+    Result total;
+    uint64_t rounds = 1;
+    auto start = Clock::now();
+    while (true) {
+        for (uint64_t r=0; r<rounds; r++) {
+            Result round = func();
+            total.messages += round.messages;
+            total.frames += round.frames;
+            total.bytes += round.bytes;
+        }
+        total.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (total.seconds >= minSeconds) break;
+        rounds *= 2;
+    }
+    return total;
+}
+inline void header(const char *title) {
+    printf("\n%s\n", title);
+    printf("%-34s %14s %14s %14s %10s\n", "case", "msg/s", "frames/s", "bytes/s", "ns/msg");
+}
+inline void report(const char *name, Result result) {
+    double sec = result.seconds > 0 ? result.seconds : 1;
+    printf("%-34s %14.0f %14.0f %14.0f %10.1f\n", name,
+        result.messages / sec,
+        result.frames / sec,
+        result.bytes / sec,
+        result.messages ? (sec * 1e9 / result.messages) : 0.0);
+}
+// Abort benchmark if self check fails
+inline void check(bool condition, const char *what) {
+    if (condition) return;
+    fprintf(stderr, "CHECK FAILED: %s\n", what);
+    exit(1);
+}
+// Prevent compiler from optimizing away computed values
+template <typename Type>
+inline void keep(Type const &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+} // namespace Bench
+
+#endif /* EXTRAS_BENCHMARK_BENCH */
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+// Host benchmark of CAN packets tunnelled over BLE characteristic (TotemCANbus)
+#include <random>
+#include <string>
+#include <vector>
+
+#include "arduino_host.h"
+#include "bench.h"
+#include "core/TotemBUS.h"
+#include "interfaces/ble/TotemCANbus.h"
+
+static const uint16_t NUMBER = 0x04;
+static const uint16_t SERIAL = 0x1234;
+static const int MTU = 517;
+static const char *tickCommands[] = {
+    "motorA", "motorB", "motorC", "motorD", "servoA", "servoB", "servoC", "led",
+};
+static const int TICK_WRITES = sizeof(tickCommands)/sizeof(tickCommands[0]);
+
+// Both ends of BLE link. Written data is passed to peer as notification
+class TunnelLink : public TotemCANbus {
+public:
+    enum class Mode {
+        Immediate,  // Write per packet
+        Message,    // cork() around message packets
+        Coalesce,   // MTU filling with flush() after tick
+    };
+    bool framing = false;
+    TunnelLink *peer = nullptr;
+    Mode mode = Mode::Immediate;
+    uint64_t writes = 0;
+    uint64_t bytes = 0;
+    uint64_t received = 0;
+    // Store received packets instead of passing to TotemBUS
+    bool capture = false;
+    std::vector<CanPacket> captured;
+    std::string lastString;
+
+    TunnelLink() {
+        bus.setCANSendBatch(onCANSendBatch);
+    }
+    void setMode(Mode mode, bool streamV2 = false, bool framing = false) {
+        this->mode = mode;
+        this->framing = framing;
+        setTxCoalescing(mode == Mode::Coalesce, 10);
+        setPackedStreamV2(streamV2);
+    }
+    bool write(CanPacket &packet) {
+        return writeCANPacket(packet.id(), packet.data(), packet.len());
+    }
+    using TotemCANbus::flush;
+    using TotemCANbus::cork;
+    using TotemCANbus::uncork;
+    using TotemCANbus::getWriteCount;
+    using TotemCANbus::getFlushTimeout;
+    void endTick() {
+        if (mode == Mode::Coalesce) flush();
+    }
+    TotemBUS &getBus() { return bus; }
+protected:
+    int getPacketLength() override {
+        return MTU-3;
+    }
+    bool onWriteData(uint8_t *data, uint32_t len) override {
+        writes++;
+        bytes += len;
+        peer->processReceivedData(data, len);
+        return true;
+    }
+    void onCANPacketReceive(uint32_t id, uint8_t *data, uint8_t len) override {
+        if (capture) captured.push_back(CanPacket(id, data, len));
+        else bus.processCAN(id, data, len);
+    }
+    void onCANMessageReceive(uint32_t id, uint8_t *data, uint16_t len) override {
+        bus.processMessage(id, data, len);
+    }
+private:
+    TotemBUS::Memory<2, 128> memory;
+    TotemBUS bus{memory, this, onCANSend, onMessage};
+
+    static bool onCANSend(void *context, TotemBUSProtocol::CanPacket &packet) {
+        return static_cast<TunnelLink*>(context)->writeCANPacket(packet.id, packet.data, packet.len);
+    }
+    static bool onCANSendBatch(void *context, TotemBUS::PacketBatch &batch) {
+        TunnelLink *link = static_cast<TunnelLink*>(context);
+        if (link->framing && !TotemBUSProtocol::Reader::isRTRCAN(batch.packets[0].id)) {
+            uint8_t data[TOTEMBUS_BATCH_FRAMES*8];
+            uint16_t len = 0;
+            for (size_t i=0; i<batch.count; i++) {
+                memcpy(&data[len], batch.packets[i].data, batch.packets[i].len);
+                len += batch.packets[i].len;
+            }
+            if (link->writeMessage(batch.packets[0].id, data, len)) return true;
+        }
+        if (link->mode == Mode::Message) link->cork();
+        bool result = true;
+        for (size_t i=0; i<batch.count; i++) {
+            if (!link->writeCANPacket(batch.packets[i].id, batch.packets[i].data, batch.packets[i].len)) result = false;
+        }
+        if (link->mode == Mode::Message) link->uncork();
+        return result;
+    }
+    static bool onMessage(void *context, TotemBUS::Message message) {
+        TunnelLink *link = static_cast<TunnelLink*>(context);
+        link->received++;
+        if (message.string.data) link->lastString.assign(message.string.data, message.string.length);
+        return true;
+    }
+};
+
+// Control loop tick: write all motor and servo values
+static Bench::Result sendTick(TunnelLink &sender, std::vector<uint32_t> &commands, int32_t value) {
+    Bench::Result result;
+    for (uint32_t cmd : commands) {
+        Bench::check(TotemBUS::write(cmd, value).send(sender.getBus(), NUMBER, SERIAL), "TotemBUS::send");
+    }
+    sender.endTick();
+    result.messages = commands.size();
+    return result;
+}
+static Bench::Result sendString(TunnelLink &sender, uint32_t cmd, std::string &str) {
+    Bench::Result result;
+    Bench::check(TotemBUS::write(cmd, {str.c_str(), (uint32_t)str.length()}).send(sender.getBus(), NUMBER, SERIAL),
+        "TotemBUS::send");
+    sender.endTick();
+    result.messages = 1;
+    return result;
+}
+// Strings of all lengths up to receive buffer arrive unchanged
+static void checkStrings(TunnelLink::Mode mode, bool streamV2, bool framing) {
+    TunnelLink sender, receiver;
+    sender.peer = &receiver;
+    receiver.peer = &sender;
+    sender.setMode(mode, streamV2, framing);
+    for (int len=0; len<120; len++) {
+        std::string str;
+        for (int i=0; i<len; i++) str += (char)('a' + (i*7+len) % 26);
+        sendString(sender, "text"_cmd, str);
+        sender.flush();
+        Bench::check(receiver.received == (uint64_t)len+1 && receiver.lastString == str, "String round trip");
+    }
+}
+
+// Reads sent under outer cork() go out in single write. Message cork() nests inside
+static void checkCorkedReads(TunnelLink::Mode mode, bool streamV2) {
+    TunnelLink sender, receiver;
+    sender.peer = &receiver;
+    receiver.peer = &sender;
+    sender.setMode(mode, streamV2);
+    sender.cork();
+    for (int i=0; i<TICK_WRITES; i++) {
+        Bench::check(TotemBUS::read(TotemBUS::hash(tickCommands[i])).send(sender.getBus(), NUMBER, SERIAL), "TotemBUS::send");
+    }
+    Bench::check(sender.getWriteCount() == 0, "Corked reads held");
+    sender.uncork();
+    Bench::check(sender.getWriteCount() == 1 && receiver.received == TICK_WRITES, "Corked reads in single write");
+}
+
+// Coalesced packet reports deadline for flush() instead of waiting for next write
+static void checkFlushTimeout() {
+    TunnelLink sender, receiver;
+    sender.peer = &receiver;
+    receiver.peer = &sender;
+    sender.setMode(TunnelLink::Mode::Coalesce);
+    Bench::check(sender.getFlushTimeout() == -1, "Nothing to flush");
+    Bench::check(TotemBUS::write("motorA"_cmd, 10).send(sender.getBus(), NUMBER, SERIAL), "TotemBUS::send");
+    int32_t timeout = sender.getFlushTimeout();
+    Bench::check(timeout >= 0 && timeout <= 10 && sender.getWriteCount() == 0, "Flush deadline set");
+    delay(11);
+    Bench::check(sender.getFlushTimeout() == 0, "Flush deadline passed");
+    sender.flush();
+    Bench::check(sender.getWriteCount() == 1 && sender.getFlushTimeout() == -1, "Flushed at deadline");
+}
+
+static bool isEqual(CanPacket &a, CanPacket &b) {
+    if (a.id() != b.id() || a.len() != b.len()) return false;
+    return a.isRTR() || memcmp(a.data(), b.data(), a.len()) == 0;
+}
+// Packets of random IDs (same, near and far from previous), lengths and RTR passed over link
+static void checkRoundTrip(TunnelLink::Mode mode, bool streamV2) {
+    std::mt19937 random(1);
+    TunnelLink sender, receiver;
+    sender.peer = &receiver;
+    receiver.peer = &sender;
+    receiver.capture = true;
+    sender.setMode(mode, streamV2);
+    std::vector<CanPacket> sent;
+    uint32_t id = 0x80000000;
+    for (int i=0; i<5000; i++) {
+        switch (random() % 5) {
+            case 0: break;
+            case 1: id += (int8_t)random(); break;
+            case 2: id += (int16_t)random(); break;
+            case 3: id = 0x80000000 | (random() & 0x1FFFFFFF); break;
+            case 4: id = random() & 0x7FF; break; // Standard
+        }
+        id = (id & 0x80000000) ? (id | 0x80000000) & 0x9FFFFFFF : (id & 0x7FF);
+        uint32_t packetId = id;
+        if (random() % 8 == 0) packetId |= 0x40000000; // RTR
+        uint8_t data[8];
+        for (auto &byte : data) byte = random();
+        sent.push_back(CanPacket(packetId, data, random() % 9));
+        Bench::check(sender.write(sent.back()), "TotemCANbus write");
+        if (random() % 16 == 0) sender.flush();
+    }
+    sender.flush();
+    Bench::check(receiver.captured.size() == sent.size(), "Packed stream packet count");
+    for (size_t i=0; i<sent.size(); i++) {
+        Bench::check(isEqual(sent[i], receiver.captured[i]), "Packed stream round trip");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.2;
+    std::vector<uint32_t> commands;
+    for (int i=0; i<TICK_WRITES; i++) commands.push_back(TotemBUS::hash(tickCommands[i]));
+    struct Case {
+        const char *name;
+        TunnelLink::Mode mode;
+        bool streamV2;
+        bool framing;
+    } cases[] = {
+        {"write per packet", TunnelLink::Mode::Immediate, false, false},
+        {"write per message (cork)", TunnelLink::Mode::Message, false, false},
+        {"MTU coalescing", TunnelLink::Mode::Coalesce, false, false},
+        {"write per packet, stream v2", TunnelLink::Mode::Immediate, true, false},
+        {"write per message, stream v2", TunnelLink::Mode::Message, true, false},
+        {"MTU coalescing, stream v2", TunnelLink::Mode::Coalesce, true, false},
+        {"native framing", TunnelLink::Mode::Immediate, false, true},
+        {"MTU coalescing, native framing", TunnelLink::Mode::Coalesce, false, true},
+    };
+    const int caseCount = sizeof(cases)/sizeof(cases[0]);
+    for (auto &test : cases) {
+        if (!test.framing) checkRoundTrip(test.mode, test.streamV2);
+        checkStrings(test.mode, test.streamV2, test.framing);
+        checkCorkedReads(test.mode, test.streamV2);
+    }
+    checkFlushTimeout();
+    printf("TotemCANbus BLE tunnel benchmark (%.2fs per case, MTU %d, %d writes per tick)\n",
+        seconds, MTU, TICK_WRITES);
+
+    Bench::header("Control tick (frames/s: BLE writes)");
+    double writesPerTick[caseCount], bytesPerTick[caseCount];
+    int index = 0;
+    for (auto &test : cases) {
+        TunnelLink sender, receiver;
+        sender.peer = &receiver;
+        receiver.peer = &sender;
+        sender.setMode(test.mode, test.streamV2, test.framing);
+        int32_t value = 0;
+        Bench::Result result = Bench::run([&]() { return sendTick(sender, commands, value++ % 100); }, seconds);
+        Bench::check(receiver.received == result.messages, "All messages received");
+        result.bytes = sender.bytes;
+        result.frames = sender.writes;
+        Bench::report(test.name, result);
+        writesPerTick[index] = (double)sender.writes * TICK_WRITES / result.messages;
+        bytesPerTick[index++] = (double)sender.bytes * TICK_WRITES / result.messages;
+    }
+    printf("\n%-34s %14s %14s\n", "case", "writes/tick", "bytes/tick");
+    for (int i=0; i<index; i++) printf("%-34s %14.2f %14.1f\n", cases[i].name, writesPerTick[i], bytesPerTick[i]);
+    // Stream v2 cases follow v1 cases of same mode
+    for (int i=3; i<6; i++) Bench::check(bytesPerTick[i] <= bytesPerTick[i-3], "Stream v2 not larger than v1");
+
+    std::string str100(100, 's');
+    Bench::header("String write 100B (frames/s: BLE writes)");
+    double writesPerMessage[caseCount], bytesPerMessage[caseCount];
+    index = 0;
+    for (auto &test : cases) {
+        TunnelLink sender, receiver;
+        sender.peer = &receiver;
+        receiver.peer = &sender;
+        sender.setMode(test.mode, test.streamV2, test.framing);
+        Bench::Result result = Bench::run([&]() { return sendString(sender, "text"_cmd, str100); }, seconds);
+        Bench::check(receiver.received == result.messages && receiver.lastString == str100, "All strings received");
+        result.bytes = sender.bytes;
+        result.frames = sender.writes;
+        Bench::report(test.name, result);
+        writesPerMessage[index] = (double)sender.writes / result.messages;
+        bytesPerMessage[index++] = (double)sender.bytes / result.messages;
+    }
+    printf("\n%-34s %14s %14s\n", "case", "writes/msg", "bytes/msg");
+    for (int i=0; i<index; i++) printf("%-34s %14.2f %14.1f\n", cases[i].name, writesPerMessage[i], bytesPerMessage[i]);
+    for (int i=3; i<6; i++) Bench::check(bytesPerMessage[i] <= bytesPerMessage[i-3], "Stream v2 not larger than v1");
+    return 0;
+}
@@ -0,0 +1,645 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+// Host benchmark of TotemBUS protocol encoder (Writer) and decoder (Reader, TotemBUS)
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "core/TotemBUS.h"
+#include "lib/BufferArena.h"
+
+using namespace TotemBUSProtocol;
+
+static const uint16_t NUMBER = 0x04;
+static const uint16_t SERIAL = 0x1234;
+
+struct Case {
+    const char *name;
+    TotemBUS::Frame frame;
+    std::vector<CanPacket> packets;
+    uint32_t bytes = 0;
+    Case(const char *name, TotemBUS::Frame frame) : name(name), frame(frame) {
+        Data data = frame.data;
+        Writer writer(data, NUMBER, SERIAL);
+        writer.setRequest(frame.isRequest);
+        CanPacket packet;
+        while (writer.getCANPacket(packet)) {
+            packets.push_back(packet);
+            bytes += packet.len;
+        }
+    }
+};
+
+static std::string longString(size_t length) {
+    std::string str;
+    for (size_t i=0; i<length; i++) str += (char)('a' + (i % 26));
+    return str;
+}
+
+static Bench::Result encode(Case &test) {
+    Data data = test.frame.data;
+    Writer writer(data, NUMBER, SERIAL);
+    writer.setRequest(test.frame.isRequest);
+    Bench::Result result;
+    CanPacket packet;
+    while (writer.getCANPacket(packet)) {
+        Bench::keep(packet);
+        result.frames++;
+        result.bytes += packet.len;
+    }
+    result.messages = 1;
+    return result;
+}
+
+static Bench::Result encodeBatch(Case &test) {
+    Data data = test.frame.data;
+    Writer writer(data, NUMBER, SERIAL);
+    writer.setRequest(test.frame.isRequest);
+    Bench::Result result;
+    CanPacket packets[64];
+    size_t count = writer.getPacketCount();
+    Bench::check(count == test.packets.size(), "Writer::getPacketCount");
+    result.frames = writer.getCANPackets(packets, count);
+    Bench::keep(packets);
+    result.bytes = test.bytes;
+    result.messages = 1;
+    return result;
+}
+
+static uint32_t sendCalls = 0;
+static CanPacket lastSent;
+static bool onCANSendCount(void *context, CanPacket &packet) {
+    Bench::keep(packet);
+    lastSent = packet;
+    sendCalls++;
+    return true;
+}
+static bool onCANSendBatch(void *context, TotemBUS::PacketBatch &batch) {
+    Bench::keep(batch.packets[0]);
+    Bench::check(batch.priority == (batch.count == 1 ? TotemBUS::Priority::Control : TotemBUS::Priority::Bulk),
+        "PacketBatch::priority");
+    sendCalls++;
+    return true;
+}
+
+static Bench::Result send(Case &test, TotemBUS &bus) {
+    Bench::Result result;
+    Bench::check(test.frame.send(bus, NUMBER, SERIAL), "TotemBUS::send");
+    result.messages = 1;
+    result.frames = test.packets.size();
+    result.bytes = test.bytes;
+    return result;
+}
+
+static Bench::Result decodeReader(Case &test, Reader &reader) {
+    Bench::Result result;
+    for (auto &packet : test.packets) {
+        Result res = reader.processCANPacket(packet.id, packet.data, packet.len);
+        if (res == Result::RECEIVED) {
+            Packet received(reader.getPacketInfo());
+            Bench::keep(received.data());
+            result.messages++;
+        }
+        else Bench::check(res == Result::OK, "Reader::processCANPacket");
+    }
+    result.frames = test.packets.size();
+    result.bytes = test.bytes;
+    return result;
+}
+
+static uint32_t busReceived = 0;
+static bool onMessage(void *context, TotemBUS::Message message) {
+    Bench::keep(message);
+    busReceived++;
+    return true;
+}
+static bool onCANSend(void *context, CanPacket &packet) {
+    return true;
+}
+
+static Bench::Result decodeBus(Case &test, TotemBUS &bus) {
+    Bench::Result result;
+    uint32_t before = busReceived;
+    for (auto &packet : test.packets) {
+        Bench::check(bus.processCAN(packet.id, packet.data, packet.len) == Result::OK, "TotemBUS::processCAN");
+    }
+    result.messages = busReceived - before;
+    result.frames = test.packets.size();
+    result.bytes = test.bytes;
+    return result;
+}
+
+// Frames of several modules compound messages arriving interleaved
+struct InterleavedCase {
+    std::vector<CanPacket> packets;
+    uint32_t bytes = 0;
+    uint32_t messages = 0;
+    InterleavedCase(int streams, const std::string &str) {
+        std::vector<std::vector<CanPacket>> perModule(streams);
+        for (int m=0; m<streams; m++) {
+            TotemBUS::Frame frame = TotemBUS::respond("name"_cmd, {str.c_str(), (uint32_t)str.length()});
+            Writer writer(frame.data, 1 + (m % 4), SERIAL + m);
+            writer.setRequest(false);
+            CanPacket packet;
+            while (writer.getCANPacket(packet)) perModule[m].push_back(packet);
+        }
+        for (size_t f=0; f<perModule[0].size(); f++) {
+            for (int m=0; m<streams; m++) {
+                packets.push_back(perModule[m][f]);
+                bytes += perModule[m][f].len;
+            }
+        }
+        messages = streams;
+    }
+};
+
+static uint32_t busCorrupted = 0;
+static std::string busExpected;
+static bool onMessageCheck(void *context, TotemBUS::Message message) {
+    if (message.type != TotemBUS::MessageType::ResponseString
+    || std::string(message.string.data, message.string.length) != busExpected)
+        busCorrupted++;
+    busReceived++;
+    return true;
+}
+
+static Bench::Result decodeInterleaved(InterleavedCase &test, TotemBUS &bus) {
+    Bench::Result result;
+    uint32_t before = busReceived;
+    for (auto &packet : test.packets) {
+        bus.processCAN(packet.id, packet.data, packet.len);
+    }
+    result.messages = busReceived - before;
+    result.frames = test.packets.size();
+    result.bytes = test.bytes;
+    Bench::check(result.messages == test.messages && busCorrupted == 0, "Interleaved streams reassembly");
+    return result;
+}
+
+// Packet of new message interrupts unfinished stream of the same module
+static Bench::Result decodeInterrupted(Case &stream, Case &basic, TotemBUS &bus) {
+    Bench::Result result;
+    uint32_t before = busReceived;
+    bus.processCAN(stream.packets[0].id, stream.packets[0].data, stream.packets[0].len);
+    bus.processCAN(basic.packets[0].id, basic.packets[0].data, basic.packets[0].len);
+    result.messages = busReceived - before;
+    result.frames = 2;
+    result.bytes = stream.packets[0].len + basic.packets[0].len;
+    Bench::check(result.messages == 1, "Interrupted stream recovery");
+    return result;
+}
+
+// Encode with or without Capability::CompactValue and decode back
+static std::vector<CanPacket> encodePackets(TotemBUS::Frame frame, bool compact) {
+    std::vector<CanPacket> packets;
+    Writer writer(frame.data, NUMBER, SERIAL);
+    writer.setRequest(frame.isRequest);
+    writer.setCompact(compact);
+    uint16_t count = writer.getPacketCount();
+    CanPacket packet;
+    while (writer.getCANPacket(packet)) packets.push_back(packet);
+    Bench::check(count == packets.size(), "Writer::getPacketCount compact");
+    return packets;
+}
+static bool decodePackets(std::vector<CanPacket> &packets, Reader &reader, PacketInfo &info) {
+    for (auto &packet : packets) {
+        Result result = reader.processCANPacket(packet.id, packet.data, packet.len);
+        if (result == Result::RECEIVED) {
+            info = reader.getPacketInfo();
+            reader.getPacketInfo().destroy();
+            return true;
+        }
+        if (result != Result::OK) return false;
+    }
+    return false;
+}
+static void checkCompact(const std::string &str) {
+    static uint8_t buffer[0xFFFF];
+    Reader reader;
+    reader.assignBuffer(buffer, sizeof(buffer));
+    TotemBUSProtocol::String string = {str.c_str(), (uint32_t)str.length()};
+    for (int32_t value : {0, -1, 127, -128, 128, -129, 300, 0x7FFF, -0x8000, 0x8000,
+            0x7FFFFF, -0x800000, 0x800000, 0x7FFFFFFF, (int32_t)0x80000000}) {
+        std::vector<TotemBUS::Frame> frames = {
+            TotemBUS::write("motorA"_cmd, value),
+            TotemBUS::write("motorA"_cmd, value, true),
+            TotemBUS::subscribe("motorA"_cmd, value),
+            TotemBUS::write("motorA"_cmd, string),
+        };
+        frames[3].data.setValue(value);
+        TotemBUS::Frame withCmdStr = TotemBUS::write("motorA"_cmd, value);
+        withCmdStr.data.setCommand(string);
+        frames.push_back(withCmdStr);
+        for (auto &frame : frames) {
+            for (bool compact : {false, true}) {
+                std::vector<CanPacket> packets = encodePackets(frame, compact);
+                PacketInfo info;
+                Bench::check(decodePackets(packets, reader, info), "Compact decode");
+                TotemBUS::Message sent = TotemBUS::encodeToMessage(NUMBER, SERIAL, frame.isRequest, frame.data);
+                TotemBUS::Message received = TotemBUS::encodeToMessage(info.number, info.serial, info.isRequest, info.data);
+                Bench::check(sent.type == received.type && sent.command == received.command
+                    && sent.value == received.value && sent.responseReq == received.responseReq
+                    && sent.string.length == received.string.length
+                    && info.data.isCommandStr() == frame.data.isCommandStr()
+                    && (!info.data.isCommandStr() || info.data.getCommandStr().length == str.length()), "Compact round trip");
+            }
+        }
+    }
+}
+static Bench::Result decodeCompact(std::vector<CanPacket> &packets, Reader &reader) {
+    Bench::Result result;
+    PacketInfo info;
+    result.messages = decodePackets(packets, reader, info) ? 1 : 0;
+    result.frames = packets.size();
+    for (auto &packet : packets) result.bytes += packet.len;
+    return result;
+}
+
+// Control tick written as separate messages or as single WriteBatch.
+// Packets are passed straight to receiving TotemBUS
+struct Link {
+    TotemBUS *receiver = nullptr;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+};
+static bool onCANLoopback(void *context, CanPacket &packet) {
+    Link *link = static_cast<Link*>(context);
+    link->frames++;
+    link->bytes += packet.len;
+    link->receiver->processCAN(packet.id, packet.data, packet.len);
+    return true;
+}
+static uint32_t itemsReceived = 0;
+static int64_t itemsSum = 0;
+static bool onMessageItems(void *context, TotemBUS::Message message) {
+    if (message.type == TotemBUS::MessageType::WriteBatch) {
+        TotemBUSProtocol::String items = message.string;
+        uint32_t command;
+        int32_t value;
+        while (TotemBUS::Batch::readItem(items, command, value)) {
+            itemsReceived++;
+            itemsSum += value;
+        }
+    }
+    else if (message.type == TotemBUS::MessageType::WriteValue) {
+        itemsReceived++;
+        itemsSum += message.value;
+    }
+    return true;
+}
+static const char *tickCommands[] = {"motorA", "motorB", "motorC", "motorD", "servoA", "servoB", "rgbAll", "led"};
+static const int32_t tickValues[] = {100, -100, 50, -50, 1000, -1000, (int32_t)0xFF00FF00, 1};
+static Bench::Result sendTick(TotemBUS &sender, Link &link, bool batched) {
+    Bench::Result result;
+    uint64_t frames = link.frames, bytes = link.bytes;
+    uint32_t before = itemsReceived;
+    int64_t sum = itemsSum;
+    int count = sizeof(tickValues)/sizeof(tickValues[0]);
+    if (batched) {
+        TotemBUS::BatchMemory<8> batch;
+        for (int i=0; i<count; i++) batch.add(TotemBUS::hash(tickCommands[i]), tickValues[i]);
+        TotemBUS::writeBatch(batch).send(sender, NUMBER, SERIAL);
+    }
+    else {
+        for (int i=0; i<count; i++) TotemBUS::write(TotemBUS::hash(tickCommands[i]), tickValues[i]).send(sender, NUMBER, SERIAL);
+    }
+    int64_t expected = 0;
+    for (int i=0; i<count; i++) expected += tickValues[i];
+    Bench::check(itemsReceived - before == (uint32_t)count && itemsSum - sum == expected, "Control tick items");
+    result.messages = 1;
+    result.frames = link.frames - frames;
+    result.bytes = link.bytes - bytes;
+    return result;
+}
+
+// Value string larger than Reader buffer is received in slices
+static std::string chunkReceived;
+static uint32_t chunkCorrupted = 0;
+static bool onStringChunk(void *context, TotemBUS::Message message, uint32_t offset, uint32_t total) {
+    if (offset != chunkReceived.length() || message.command != "motorA"_cmd)
+        chunkCorrupted++;
+    chunkReceived.append(message.string.data, message.string.length);
+    if (chunkReceived.length() == total) {
+        if (chunkReceived != busExpected) chunkCorrupted++;
+        chunkReceived.clear();
+        busReceived++;
+    }
+    return true;
+}
+static Bench::Result decodeChunked(Case &test, TotemBUS &bus) {
+    Bench::Result result;
+    uint32_t before = busReceived;
+    for (auto &packet : test.packets) {
+        bus.processCAN(packet.id, packet.data, packet.len);
+    }
+    result.messages = busReceived - before;
+    result.frames = test.packets.size();
+    result.bytes = test.bytes;
+    Bench::check(result.messages == 1 && chunkCorrupted == 0, "Chunked string reassembly");
+    return result;
+}
+
+// Each thread decodes with own TotemBUS instance
+static bool onMessageCount(void *context, TotemBUS::Message message) {
+    (*static_cast<uint64_t*>(context))++;
+    return true;
+}
+static Bench::Result decodeParallel(Case &test, int threads, double seconds) {
+    std::vector<std::thread> workers;
+    std::vector<Bench::Result> results(threads);
+    for (int t=0; t<threads; t++) {
+        workers.emplace_back([&, t]() {
+            uint64_t received = 0;
+            TotemBUS::Memory<1, 256> memory;
+            TotemBUS bus(memory, &received, onCANSend, onMessageCount);
+            results[t] = Bench::run([&]() {
+                Bench::Result result;
+                uint64_t before = received;
+                for (auto &packet : test.packets) {
+                    bus.processCAN(packet.id, packet.data, packet.len);
+                }
+                result.messages = received - before;
+                result.frames = test.packets.size();
+                result.bytes = test.bytes;
+                return result;
+            }, seconds);
+            Bench::check(received != 0, "Parallel decode");
+        });
+    }
+    Bench::Result total;
+    for (int t=0; t<threads; t++) {
+        workers[t].join();
+        total.messages += results[t].messages;
+        total.frames += results[t].frames;
+        total.bytes += results[t].bytes;
+        if (results[t].seconds > total.seconds) total.seconds = results[t].seconds;
+    }
+    return total;
+}
+
+static Bench::Result toMessage(Case &test, PacketInfo &info) {
+    Bench::Result result;
+    TotemBUS::Message message = TotemBUS::encodeToMessage(info.number, info.serial, info.isRequest, info.data);
+    Bench::keep(message);
+    result.messages = 1;
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.2;
+    std::string str16 = longString(16);
+    std::string str240 = longString(240);
+    uint32_t cmd = "motorA"_cmd;
+    std::vector<Case> cases;
+    cases.emplace_back("Basic int8", TotemBUS::write(cmd, 100));
+    cases.emplace_back("Basic int32", TotemBUS::write(cmd, 0x01020304));
+    cases.emplace_back("Compound command", TotemBUS::write(cmd, true));
+    cases.emplace_back("CompoundExt string 16B", TotemBUS::write(cmd, {str16.c_str(), (uint32_t)str16.length()}));
+    cases.emplace_back("CompoundExt string 240B", TotemBUS::write(cmd, {str240.c_str(), (uint32_t)str240.length()}));
+
+    printf("TotemBUS codec benchmark (%.2fs per case)\n", seconds);
+    for (auto &test : cases) {
+        printf("  %-30s %3u frames %4u bytes\n", test.name, (unsigned)test.packets.size(), (unsigned)test.bytes);
+    }
+
+    Bench::header("Encode: Writer::getCANPacket");
+    for (auto &test : cases) {
+        Bench::report(test.name, Bench::run([&]() { return encode(test); }, seconds));
+    }
+
+    Bench::header("Encode: Writer::getCANPackets");
+    for (auto &test : cases) {
+        Bench::report(test.name, Bench::run([&]() { return encodeBatch(test); }, seconds));
+    }
+
+    Bench::header("Send: TotemBUS CallbackCANSend per packet");
+    for (auto &test : cases) {
+        TotemBUS bus(nullptr, nullptr, onCANSendCount, onMessage);
+        sendCalls = 0;
+        Bench::Result result = Bench::run([&]() { return send(test, bus); }, seconds);
+        Bench::check(sendCalls == result.frames, "CallbackCANSend calls");
+        Bench::report(test.name, result);
+    }
+
+    Bench::header("Send: TotemBUS CallbackCANSendBatch per message");
+    for (auto &test : cases) {
+        TotemBUS bus(nullptr, nullptr, onCANSendCount, onMessage);
+        bus.setCANSendBatch(onCANSendBatch);
+        sendCalls = 0;
+        Bench::Result result = Bench::run([&]() { return send(test, bus); }, seconds);
+        Bench::check(sendCalls == result.messages, "CallbackCANSendBatch calls");
+        Bench::report(test.name, result);
+    }
+
+    Bench::header("Decode: Reader::processCANPacket");
+    static uint8_t readerBuffer[256];
+    for (auto &test : cases) {
+        Reader reader;
+        reader.assignBuffer(readerBuffer, sizeof(readerBuffer));
+        Bench::report(test.name, Bench::run([&]() { return decodeReader(test, reader); }, seconds));
+    }
+
+    Bench::header("Decode: TotemBUS::processCAN");
+    for (auto &test : cases) {
+        TotemBUS::Memory<1, 256> memory;
+        TotemBUS bus(memory, nullptr, onCANSend, onMessage);
+        Bench::report(test.name, Bench::run([&]() { return decodeBus(test, bus); }, seconds));
+    }
+
+    Bench::header("Decode: TotemBUS::processCAN interleaved streams");
+    busExpected = str16;
+    for (int streams : {2, 8, 32}) {
+        InterleavedCase test(streams, busExpected);
+        TotemBUS::Memory<32, 64> memory;
+        TotemBUS bus(memory, nullptr, onCANSend, onMessageCheck);
+        std::string name = std::to_string(streams) + " streams x string 16B";
+        Bench::report(name.c_str(), Bench::run([&]() { return decodeInterleaved(test, bus); }, seconds));
+    }
+
+    Bench::header("Decode: TotemBUS::processCAN Reader buffers leased from arena");
+    {
+        TotemLib::BufferArena arena({64, 256}, {32, 4});
+        Bench::check(arena.getSize() == 0, "Arena memory allocated on lease");
+        for (auto &test : cases) {
+            TotemBUS::LeasedMemory<1> memory(arena.readerSource(256));
+            TotemBUS bus(memory, nullptr, onCANSend, onMessage);
+            Bench::report(test.name, Bench::run([&]() { return decodeBus(test, bus); }, seconds));
+        }
+        for (int streams : {8, 32}) {
+            InterleavedCase test(streams, busExpected);
+            TotemBUS::LeasedMemory<32> memory(arena.readerSource(64));
+            TotemBUS bus(memory, nullptr, onCANSend, onMessageCheck);
+            std::string name = std::to_string(streams) + " streams x string 16B";
+            Bench::report(name.c_str(), Bench::run([&]() { return decodeInterleaved(test, bus); }, seconds));
+        }
+        // Streams without free block are dropped whole
+        {
+            TotemLib::BufferArena small({64}, {2});
+            InterleavedCase test(8, busExpected);
+            TotemBUS::LeasedMemory<8> memory(small.readerSource(64));
+            TotemBUS bus(memory, nullptr, onCANSend, onMessageCheck);
+            uint32_t before = busReceived;
+            for (auto &packet : test.packets) bus.processCAN(packet.id, packet.data, packet.len);
+            Bench::check(busReceived - before == 2 && busCorrupted == 0 && small.getFailedCount() > 0, "Arena exhausted");
+        }
+        printf("\n%-34s %14s %14s %14s\n", "arena block", "blocks", "leased now", "high-water");
+        for (int i=0; i<arena.getClassCount(); i++) {
+            TotemLib::BufferArena::Stats stats = arena.getStats(i);
+            Bench::check(stats.used == 0, "Reader buffers returned");
+            printf("%-34u %14u %14u %14u\n", stats.size, stats.blocks, stats.used, stats.highWater);
+        }
+        printf("%-34s %14u bytes, %u allocated\n", "high-water", arena.getHighWater(), arena.getSize());
+    }
+
+    Bench::header("Decode: TotemBUS::processCAN interrupted stream");
+    {
+        TotemBUS::Memory<1, 256> memory;
+        TotemBUS bus(memory, nullptr, onCANSend, onMessage);
+        Bench::report("Compound start + Basic int8", Bench::run([&]() {
+            return decodeInterrupted(cases[4], cases[0], bus);
+        }, seconds));
+    }
+    // Single packet message of other module does not take Reader of stream in
+    // flight. Other stream gets it only after stream in flight is idle
+    {
+        std::vector<uint16_t> received;
+        TotemBUS::Memory<1, 256> memory;
+        TotemBUS bus(memory, &received, onCANSend, [](void *context, TotemBUS::Message message) {
+            static_cast<std::vector<uint16_t>*>(context)->push_back(message.number);
+            return true;
+        });
+        auto otherPackets = [](Case &test) {
+            std::vector<CanPacket> packets;
+            Writer writer(test.frame.data, NUMBER+1, SERIAL);
+            writer.setRequest(test.frame.isRequest);
+            CanPacket packet;
+            while (writer.getCANPacket(packet)) packets.push_back(packet);
+            return packets;
+        };
+        std::vector<CanPacket> basic = otherPackets(cases[0]);
+        std::vector<CanPacket> stream = otherPackets(cases[3]);
+        std::vector<CanPacket> &inFlight = cases[4].packets;
+        bus.processCAN(inFlight[0].id, inFlight[0].data, inFlight[0].len);
+        bus.processCAN(basic[0].id, basic[0].data, basic[0].len);
+        for (auto &packet : stream) bus.processCAN(packet.id, packet.data, packet.len);
+        for (size_t i=1; i<inFlight.size(); i++) bus.processCAN(inFlight[i].id, inFlight[i].data, inFlight[i].len);
+        Bench::check(received == std::vector<uint16_t>{NUMBER+1, NUMBER}, "Stream in flight kept Reader");
+        received.clear();
+        bus.processCAN(inFlight[0].id, inFlight[0].data, inFlight[0].len);
+        for (int i=0; i<TOTEMBUS_READER_IDLE_PACKETS; i++) {
+            for (auto &packet : stream) bus.processCAN(packet.id, packet.data, packet.len);
+        }
+        Bench::check(!received.empty() && received.back() == NUMBER+1, "Idle stream Reader taken");
+    }
+
+    Bench::header("Decode: Reader::processCANPacket legacy vs CompactValue");
+    for (size_t length : {0, 16, 200, 1000}) checkCompact(longString(length));
+    {
+        std::vector<std::pair<const char*, TotemBUS::Frame>> compactCases = {
+            {"write int16", TotemBUS::write(cmd, 300)},
+            {"write int16 + response", TotemBUS::write(cmd, 300, true)},
+            {"subscribe int24", TotemBUS::subscribe(cmd, 100000)},
+            {"string 200B + int16", TotemBUS::write(cmd, {str240.c_str(), 200})},
+        };
+        compactCases[3].second.data.setValue(1000);
+        for (auto &test : compactCases) {
+            for (bool compact : {false, true}) {
+                std::vector<CanPacket> packets = encodePackets(test.second, compact);
+                Reader reader;
+                reader.assignBuffer(readerBuffer, sizeof(readerBuffer));
+                std::string name = std::string(test.first) + (compact ? " (compact)" : " (legacy)");
+                Bench::report(name.c_str(), Bench::run([&]() { return decodeCompact(packets, reader); }, seconds));
+            }
+        }
+    }
+
+    printf("\nSend: TotemBUS capability negotiation\n");
+    {
+        TotemBUS::Memory<1, 64> memory;
+        TotemBUS bus(memory, nullptr, onCANSendCount, onMessage);
+        Bench::check(bus.getPeerCapabilities(NUMBER, SERIAL) == 0, "No capabilities before negotiation");
+        Case response("", TotemBUS::respondCapabilities(TotemBUSProtocol::Capability::CompactValue));
+        for (auto &packet : response.packets) bus.processCAN(packet.id, packet.data, packet.len);
+        Bench::check(bus.getPeerCapabilities(NUMBER, SERIAL) == 0, "Capabilities are opt-in");
+        bus.setCapabilities(TotemBUSProtocol::Capability::CompactValue);
+        TotemBUS::ping(3).send(bus, NUMBER, SERIAL);
+        Bench::check(lastSent.len == 3, "Ping data is not changed");
+        Bench::check(bus.negotiate(NUMBER, SERIAL), "TotemBUS::negotiate");
+        for (auto &packet : response.packets) bus.processCAN(packet.id, packet.data, packet.len);
+        Bench::check(bus.getPeerCapabilities(NUMBER, SERIAL) == TotemBUSProtocol::Capability::CompactValue, "Negotiated capabilities");
+        Bench::check(bus.getPeerCapabilities(NUMBER, 0) == TotemBUSProtocol::Capability::CompactValue, "Negotiated capabilities by number");
+        // Old firmware echoes ping request as response
+        CanPacket echo = Writer::getPingPacket(NUMBER, SERIAL+1, false, 0xF);
+        bus.processCAN(echo.id, echo.data, echo.len);
+        Bench::check(bus.getPeerCapabilities(NUMBER, SERIAL+1) == 0, "Ping echo is not negotiation");
+        Bench::check(bus.getPeerCapabilities(NUMBER, 0) == TotemBUSProtocol::Capability::CompactValue, "Legacy module not stored");
+        for (bool compact : {false, true}) {
+            TotemBUS::Frame frame = TotemBUS::write(cmd, 300, true);
+            sendCalls = 0;
+            uint32_t serial = compact ? SERIAL : SERIAL+1;
+            frame.send(bus, NUMBER, serial);
+            Bench::check(sendCalls == (compact ? 1U : 2U), "Compact encoding used after negotiation");
+            printf("%-34s %u packets\n", compact ? "negotiated module" : "legacy module", sendCalls);
+        }
+        // Board connected directly is addressed as (0, 0)
+        bus.setPeerCapabilities(0, 0, TotemBUSProtocol::Capability::CompactValue);
+        TotemBUS::Frame frame = TotemBUS::write(cmd, 300, true);
+        sendCalls = 0;
+        frame.send(bus, 0, 0);
+        Bench::check(sendCalls == 1, "Compact encoding used for direct peer");
+    }
+
+    Bench::header("Send: control tick of 8 writes (msg = tick)");
+    for (int mode=0; mode<3; mode++) {
+        TotemBUS::Memory<1, 256> receiverMemory;
+        TotemBUS receiver(receiverMemory, nullptr, onCANSend, onMessageItems);
+        Link link;
+        link.receiver = &receiver;
+        TotemBUS::Memory<1, 16> senderMemory;
+        TotemBUS sender(senderMemory, &link, onCANLoopback, onMessage);
+        if (mode == 2) {
+            sender.setCapabilities(TotemBUSProtocol::Capability::WriteBatch | TotemBUSProtocol::Capability::CompactValue);
+            Case response("", TotemBUS::respondCapabilities(0xF));
+            for (auto &packet : response.packets) sender.processCAN(packet.id, packet.data, packet.len);
+        }
+        const char *names[] = {"separate writes", "WriteBatch (legacy module)", "WriteBatch (negotiated)"};
+        Bench::report(names[mode], Bench::run([&]() { return sendTick(sender, link, mode != 0); }, seconds));
+    }
+
+    Bench::header("Decode: TotemBUS::processCAN chunked string (32B buffer)");
+    for (size_t length : {240, 4000}) {
+        busExpected = longString(length);
+        Case test("", TotemBUS::write(cmd, {busExpected.c_str(), (uint32_t)busExpected.length()}));
+        TotemBUS::Memory<1, 32> memory;
+        TotemBUS bus(memory, nullptr, onCANSend, onMessage);
+        bus.setStringChunkReceiver(onStringChunk);
+        std::string name = "string " + std::to_string(length) + "B";
+        Bench::report(name.c_str(), Bench::run([&]() { return decodeChunked(test, bus); }, seconds));
+    }
+
+    Bench::header("Decode: TotemBUS::processCAN parallel instances (string 240B)");
+    for (int threads : {1, 2, 4}) {
+        std::string name = std::to_string(threads) + " threads";
+        Bench::report(name.c_str(), decodeParallel(cases[4], threads, seconds));
+    }
+
+    Bench::header("Decode: TotemBUS::encodeToMessage");
+    for (auto &test : cases) {
+        Reader reader;
+        reader.assignBuffer(readerBuffer, sizeof(readerBuffer));
+        PacketInfo info;
+        for (auto &packet : test.packets) {
+            if (reader.processCANPacket(packet.id, packet.data, packet.len) == Result::RECEIVED) {
+                info = reader.getPacketInfo();
+            }
+        }
+        Bench::report(test.name, Bench::run([&]() { return toMessage(test, info); }, seconds));
+    }
+    return 0;
+}
@@ -0,0 +1,464 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+// Host benchmark of TotemModule API and ModuleList dispatch against
+// simulated modules (VirtualModule) connected over LoopbackTransport
+#include "arduino_host.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "virtual_module.h"
+#include "api/TotemModule.h"
+#include "lib/MessageQueue.h"
+#include "lib/TransportNetwork.h"
+#include "interfaces/loopback/LoopbackTransport.h"
+
+using namespace TotemLib;
+
+static const uint16_t NUMBER = 10;
+static const int WAIT_MODULES = 16; // Modules used per round of blocking calls
+static const int CONFIG_WRITES = 30; // Parameters written per configuration burst
+static const int LOOP_READS = 6; // Values read by control loop tick
+static const int READ_TASKS = 4; // Tasks reading same module at once
+
+// Network without transport. Messages are passed to ModuleList directly
+class DispatchNetwork : public TotemNetwork {
+public:
+    using TotemNetwork::networkSend;
+    using TotemNetwork::moduleListRelocateFrom;
+    bool networkSend(TotemBUS::Frame &frame, int number, int serial) override {
+        return true;
+    }
+    void dispatch(TotemBUS::Message &message) {
+        moduleListCallMessageReceive(message);
+    }
+    void receive(TotemBUS::Message &message) {
+        onMessageReceive(message);
+    }
+};
+
+static std::atomic<uint64_t> dataReceived(0);
+static uint64_t dispatchReceived = 0;
+static std::atomic<uint64_t> churnReceived(0);
+static std::atomic<uint64_t> slowReceived(0);
+static std::string lastString;
+// Application receiver that takes 20us per value
+static void onSlowData(ModuleData data) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+    while (std::chrono::steady_clock::now() < end);
+    if (data.isString()) lastString = data.getString();
+    slowReceived++;
+}
+static void onModuleData(ModuleData data) {
+    dataReceived++;
+}
+// Receiver that readdresses its module and destroys other module
+static TotemModule *readdressed = nullptr;
+static TotemModule *destroyed = nullptr;
+static void onReaddress(ModuleData data) {
+    dispatchReceived++;
+    if (destroyed == nullptr) return;
+    readdressed->setSerial(9);
+    delete destroyed;
+    destroyed = nullptr;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.2;
+    int count = (argc > 2) ? atoi(argv[2]) : 256;
+    uint32_t cmd = "value"_cmd;
+    printf("TotemModule benchmark with %d virtual modules (%.2fs per case)\n", count, seconds);
+
+    LoopbackTransport hostLink, modulesLink(hostLink);
+    Bench::VirtualBus simulator(modulesLink);
+    std::vector<std::unique_ptr<TotemModule>> modules;
+    for (int i=0; i<count; i++) {
+        uint16_t serial = i+1;
+        Bench::VirtualModule &module = simulator.add(NUMBER, serial);
+        module.set(cmd, serial);
+        if (i == 0) {
+            for (int t=0; t<READ_TASKS; t++) module.set(cmd + 100 + t, 100 + t);
+        }
+        modules.emplace_back(new TotemModule(NUMBER, serial, onModuleData));
+    }
+    TransportNetwork network(hostLink);
+    network.begin();
+
+    std::atomic<bool> running(true);
+    std::thread networkTask([&]() {
+        while (running) network.poll(1);
+    });
+    simulator.start([]() { return (uint32_t)millis(); });
+
+    Bench::header("TotemModule::write (no response)");
+    {
+        uint64_t sent = 0;
+        Bench::Result result = Bench::run([&]() {
+            Bench::Result round;
+            for (auto &module : modules) {
+                Bench::check(module->write(cmd, (int32_t)sent), "TotemModule::write");
+            }
+            sent += modules.size();
+            round.messages = modules.size();
+            return round;
+        }, seconds);
+        uint64_t writes = 0;
+        for (int wait=0; wait<200; wait++) {
+            writes = 0;
+            for (auto module : simulator.getModules()) writes += module->getWrites();
+            if (writes == sent) break;
+            delay(5);
+        }
+        Bench::check(writes == sent, "Virtual modules received all writes");
+        Bench::report("write to each module", result);
+    }
+
+    Bench::header("TotemModule blocking round trip");
+    Bench::report("writeWait", Bench::run([&]() {
+        Bench::Result round;
+        for (int i=0; i<WAIT_MODULES && i<count; i++) {
+            Bench::check(modules[i]->writeWait(cmd, i+1), "TotemModule::writeWait");
+        }
+        round.messages = (WAIT_MODULES < count) ? WAIT_MODULES : count;
+        return round;
+    }, seconds));
+    Bench::report("readWait", Bench::run([&]() {
+        Bench::Result round;
+        for (int i=0; i<WAIT_MODULES && i<count; i++) {
+            ModuleData data;
+            Bench::check(modules[i]->readWait(cmd, data) && data.getInt() == i+1, "TotemModule::readWait");
+        }
+        round.messages = (WAIT_MODULES < count) ? WAIT_MODULES : count;
+        return round;
+    }, seconds));
+    Bench::report("readWait from 4 tasks", Bench::run([&]() {
+        Bench::Result round;
+        std::vector<std::thread> tasks;
+        for (int t=0; t<READ_TASKS; t++) {
+            tasks.emplace_back([&, t]() {
+                for (int i=0; i<WAIT_MODULES; i++) {
+                    ModuleData data;
+                    Bench::check(modules[0]->readWait(cmd + 100 + t, data) && data.getInt() == 100 + t, "Concurrent readWait gets own value");
+                }
+            });
+        }
+        for (auto &task : tasks) task.join();
+        round.messages = READ_TASKS * WAIT_MODULES;
+        return round;
+    }, seconds));
+
+    Bench::header("Configuration burst (30 acknowledged writes)");
+    {
+        uint32_t commands[CONFIG_WRITES];
+        int32_t values[CONFIG_WRITES];
+        for (int i=0; i<CONFIG_WRITES; i++) commands[i] = cmd + 1 + i;
+        int32_t round = 0;
+        Bench::report("writeWait per parameter", Bench::run([&]() {
+            Bench::Result result;
+            round++;
+            for (int i=0; i<CONFIG_WRITES; i++) {
+                Bench::check(modules[0]->writeWait(commands[i], round + i), "TotemModule::writeWait");
+            }
+            result.messages = CONFIG_WRITES;
+            return result;
+        }, seconds));
+        Bench::report("writeWaitAll", Bench::run([&]() {
+            Bench::Result result;
+            round++;
+            for (int i=0; i<CONFIG_WRITES; i++) values[i] = round + i;
+            Bench::check(modules[0]->writeWaitAll(commands, values, CONFIG_WRITES), "TotemModule::writeWaitAll");
+            result.messages = CONFIG_WRITES;
+            return result;
+        }, seconds));
+        int32_t stored = 0;
+        Bench::check(simulator.getModules()[0]->get(commands[CONFIG_WRITES-1], stored) && stored == values[CONFIG_WRITES-1],
+            "Configuration burst stored");
+    }
+
+    Bench::header("Control loop reads (6 values subscribed at 20 ms)");
+    {
+        TotemModule &module = *modules[count > 1 ? 1 : 0];
+        uint32_t commands[LOOP_READS];
+        int32_t values[LOOP_READS];
+        for (int i=0; i<LOOP_READS; i++) {
+            commands[i] = cmd + 100 + i;
+            values[i] = 1000 + i;
+        }
+        Bench::check(module.writeWaitAll(commands, values, LOOP_READS), "TotemModule::writeWaitAll");
+        for (int i=0; i<LOOP_READS; i++) {
+            Bench::check(module.subscribeWait(commands[i], 20), "TotemModule::subscribeWait");
+        }
+        delay(50);
+        Bench::report("readWait", Bench::run([&]() {
+            Bench::Result round;
+            for (int i=0; i<LOOP_READS; i++) {
+                ModuleData data;
+                Bench::check(module.readWait(commands[i], data) && data.getInt() == values[i], "TotemModule::readWait");
+            }
+            round.messages = LOOP_READS;
+            return round;
+        }, seconds));
+        uint64_t remote = 0;
+        Bench::report("readCached (50 ms bound)", Bench::run([&]() {
+            Bench::Result round;
+            for (int i=0; i<LOOP_READS; i++) {
+                ModuleData data;
+                if (module.getCachedTime(commands[i]) == 0 || millis() - module.getCachedTime(commands[i]) > 50) remote++;
+                Bench::check(module.readCached(commands[i], data, 50) && data.getInt() == values[i], "TotemModule::readCached");
+            }
+            round.messages = LOOP_READS;
+            return round;
+        }, seconds));
+        printf("%-34s %14llu\n", "reads sent to module", (unsigned long long)remote);
+        for (int i=0; i<LOOP_READS; i++) module.unsubscribeWait(commands[i]);
+    }
+
+    Bench::header("ModuleList dispatch (message to one of N modules)");
+    for (int listSize : {4, 32, 256}) {
+        std::vector<std::unique_ptr<TotemModule>> listed;
+        DispatchNetwork dispatcher;
+        for (int i=0; i<listSize; i++) {
+            listed.emplace_back(new TotemModule(NUMBER+1, i+1, [](ModuleData data) { dispatchReceived++; }));
+            dispatcher.attach(*listed.back());
+        }
+        TotemBUS::Message message;
+        message.type = TotemBUS::MessageType::ResponseValue;
+        message.number = NUMBER+1;
+        message.command = cmd;
+        uint16_t serial = 0;
+        dispatchReceived = 0;
+        Bench::Result result = Bench::run([&]() {
+            Bench::Result round;
+            for (int i=0; i<1000; i++) {
+                message.serial = (serial++ % listSize) + 1;
+                dispatcher.dispatch(message);
+            }
+            round.messages = 1000;
+            return round;
+        }, seconds);
+        Bench::check(dispatchReceived == result.messages, "Message received by single module");
+        std::string name = std::to_string(listSize) + " modules";
+        Bench::report(name.c_str(), result);
+        listed.clear();
+    }
+
+    Bench::header("ModuleList dispatch while other thread attaches and destroys modules");
+    {
+        std::vector<std::unique_ptr<TotemModule>> listed;
+        DispatchNetwork dispatcher;
+        for (int i=0; i<32; i++) {
+            listed.emplace_back(new TotemModule(NUMBER+1, i+1, [](ModuleData data) { dispatchReceived++; }));
+            dispatcher.attach(*listed.back());
+        }
+        dispatchReceived = 0;
+        std::atomic<bool> churning(true);
+        uint64_t churned = 0;
+        std::thread churn([&]() {
+            while (churning) {
+                // Same addresses as dispatched messages
+                TotemModule module(NUMBER+1, (churned % 32) + 1, [](ModuleData data) { churnReceived++; });
+                dispatcher.attach(module);
+                module.setSerial(((churned + 7) % 32) + 1);
+                churned++;
+            }
+        });
+        TotemBUS::Message message;
+        message.type = TotemBUS::MessageType::ResponseValue;
+        message.number = NUMBER+1;
+        message.command = cmd;
+        uint16_t serial = 0;
+        Bench::Result result = Bench::run([&]() {
+            Bench::Result round;
+            for (int i=0; i<1000; i++) {
+                message.serial = (serial++ % 32) + 1;
+                dispatcher.dispatch(message);
+            }
+            round.messages = 1000;
+            return round;
+        }, seconds);
+        churning = false;
+        churn.join();
+        Bench::check(dispatchReceived == result.messages, "Message received by attached module");
+        Bench::report("32 modules, churn", result);
+        printf("%-34s %14llu\n", "modules attached and destroyed", (unsigned long long)churned);
+        listed.clear();
+    }
+
+    {
+        // Callback removes current and next observer. Must not wait for itself
+        Observer observers[8];
+        LinkedObservers<> list;
+        for (auto &observer : observers) list.add(observer);
+        int visited = 0;
+        list.for_each([&](Observer *observer) {
+            visited++;
+            list.remove(*observer);
+            if (observer + 1 < observers + 8) list.remove(*(observer + 1));
+            list.synchronize();
+        });
+        Bench::check(visited == 4 && list.isEmpty(), "LinkedObservers removal inside for_each");
+    }
+
+    {
+        DispatchNetwork dispatcher;
+        // Destroyed module is next in bucket of same address
+        destroyed = new TotemModule(NUMBER+3, 1, onReaddress);
+        readdressed = new TotemModule(NUMBER+3, 1, onReaddress);
+        dispatcher.attach(*destroyed);
+        dispatcher.attach(*readdressed);
+        TotemBUS::Message message;
+        message.type = TotemBUS::MessageType::ResponseValue;
+        message.number = NUMBER+3;
+        message.serial = 1;
+        message.command = cmd;
+        dispatchReceived = 0;
+        dispatcher.dispatch(message);
+        message.serial = 9;
+        dispatcher.dispatch(message);
+        Bench::check(dispatchReceived == 2 && destroyed == nullptr, "Module readdressed and destroyed inside dispatch");
+        delete readdressed;
+    }
+    {
+        // Relocation while other thread attaches and readdresses modules
+        DispatchNetwork first, second;
+        std::vector<std::unique_ptr<TotemModule>> listed;
+        for (int i=0; i<8; i++) {
+            listed.emplace_back(new TotemModule(NUMBER+4, i+1, [](ModuleData data) { dispatchReceived++; }));
+            first.attach(*listed.back());
+        }
+        std::atomic<bool> relocating(true);
+        std::thread relocate([&]() {
+            while (relocating) {
+                second.moduleListRelocateFrom(first);
+                first.moduleListRelocateFrom(second);
+            }
+        });
+        for (int i=0; i<2000; i++) {
+            TotemModule module(NUMBER+4, 100 + i % 8);
+            first.attach(module);
+            module.setSerial(200 + i % 8);
+        }
+        relocating = false;
+        relocate.join();
+        TotemBUS::Message message;
+        message.type = TotemBUS::MessageType::ResponseValue;
+        message.number = NUMBER+4;
+        message.command = cmd;
+        dispatchReceived = 0;
+        for (int i=0; i<8; i++) {
+            message.serial = i+1;
+            first.dispatch(message);
+        }
+        Bench::check(dispatchReceived == 8, "Modules indexed once after relocation");
+    }
+    {
+        // Relocation waits for dispatch of source list. Moved modules receive
+        // messages of new list meanwhile
+        static std::atomic<bool> blocking;
+        static std::atomic<int> relocatedReceived;
+        DispatchNetwork first, second;
+        TotemModule module(NUMBER+5, 1, [](ModuleData data) {
+            if (data.getInt() == 1) while (blocking) std::this_thread::yield();
+            else relocatedReceived++;
+        });
+        first.attach(module);
+        TotemBUS::Message message;
+        message.type = TotemBUS::MessageType::ResponseValue;
+        message.number = NUMBER+5;
+        message.serial = 1;
+        message.command = cmd;
+        message.value = 1;
+        blocking = true;
+        relocatedReceived = 0;
+        TotemBUS::Message blocked = message;
+        std::thread dispatch([&]() { first.dispatch(blocked); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::thread relocate([&]() { second.moduleListRelocateFrom(first); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        message.value = 2;
+        second.dispatch(message);
+        blocking = false;
+        relocate.join();
+        dispatch.join();
+        second.dispatch(message);
+        Bench::check(relocatedReceived == 2, "Messages delivered during relocation");
+    }
+
+    Bench::header("Receive with slow data receiver (20 us per value)");
+    for (bool deferred : {false, true}) {
+        StaticMessageQueue<16384> queue;
+        DispatchNetwork dispatcher;
+        TotemModule module(NUMBER+2, 1, onSlowData);
+        dispatcher.attach(module);
+        if (deferred) dispatcher.setEventQueue(&queue);
+        TotemBUS::Message message;
+        message.type = TotemBUS::MessageType::ResponseString;
+        message.number = NUMBER+2;
+        message.serial = 1;
+        message.command = cmd;
+        message.string = {"deferred", 8};
+        slowReceived = 0;
+        dispatcher.receive(message);
+        dispatcher.pollEvents();
+        Bench::check(slowReceived == 1 && lastString == "deferred", "String passed to receiver");
+        slowReceived = 0;
+        // Application task draining events
+        std::atomic<bool> draining(deferred);
+        std::thread consumer([&]() {
+            while (draining) {
+                if (dispatcher.waitEvents(10)) dispatcher.pollEvents();
+            }
+            dispatcher.pollEvents();
+        });
+        message.type = TotemBUS::MessageType::ResponseValue;
+        message.string = {nullptr, 0};
+        Bench::Result result = Bench::run([&]() {
+            Bench::Result round;
+            for (int i=0; i<100; i++) {
+                message.value = i;
+                dispatcher.receive(message);
+            }
+            round.messages = 100;
+            return round;
+        }, seconds);
+        draining = false;
+        consumer.join();
+        Bench::check(slowReceived + queue.getDropped() == result.messages, "Values received or dropped");
+        Bench::report(deferred ? "event queue, receive context" : "receiver in receive context", result);
+        if (deferred) {
+            printf("%-34s %14llu\n", "values passed to receiver", (unsigned long long)slowReceived);
+            printf("%-34s %14llu\n", "values dropped (queue full)", (unsigned long long)queue.getDropped());
+        }
+    }
+
+    Bench::header("ModuleList dispatch of subscriptions (20 ms interval)");
+    {
+        for (auto &module : modules) {
+            Bench::check(module->subscribe(cmd, 20), "TotemModule::subscribe");
+        }
+        delay(50);
+        uint64_t start = dataReceived;
+        Bench::Result result;
+        auto begin = std::chrono::steady_clock::now();
+        delay(seconds < 0.1 ? 100 : seconds * 1000);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        result.messages = dataReceived - start;
+        for (auto &module : modules) module->unsubscribe(cmd);
+        Bench::check(result.messages != 0, "Subscribed values received");
+        std::string name = std::to_string(count) + " subscribed modules";
+        Bench::report(name.c_str(), result);
+    }
+
+    simulator.stop();
+    running = false;
+    networkTask.join();
+    network.end();
+    return 0;
+}
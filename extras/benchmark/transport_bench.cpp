@@ -0,0 +1,184 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+// Host benchmark of TotemBUS running over TotemTransport (loopback, UDP)
+#include <string>
+#include <thread>
+
+#include "bench.h"
+#include "core/TotemBUS.h"
+#include "interfaces/loopback/LoopbackTransport.h"
+#include "interfaces/udp/UDPTransport.h"
+
+using namespace TotemLib;
+
+static const uint16_t NUMBER = 0x04;
+static const uint16_t SERIAL = 0x1234;
+static const int ROUND = 256; // Messages sent before receiving side polls
+
+// TotemBUS attached to transport, same as TransportNetwork without module list
+struct Endpoint : public TotemTransport::Receiver {
+    TotemBUS::Memory<4, 256> memory;
+    TotemBUS bus;
+    TotemTransport &transport;
+    uint64_t received = 0;
+    uint64_t packets = 0;
+    Endpoint(TotemTransport &transport) :
+    bus(memory, this, onCANSend, onMessage),
+    transport(transport) {
+        bus.setCANSendBatch(onCANSendBatch);
+        transport.setReceiver(this);
+    }
+    void onTransportReceive(uint32_t id, uint8_t *data, uint8_t len) override {
+        packets++;
+        bus.processCAN(id, data, len);
+    }
+    static bool onCANSend(void *context, TotemBUSProtocol::CanPacket &packet) {
+        return static_cast<Endpoint*>(context)->transport.transportSend(&packet, 1);
+    }
+    static bool onCANSendBatch(void *context, TotemBUS::PacketBatch &batch) {
+        return static_cast<Endpoint*>(context)->transport.transportSend(batch.packets, batch.count);
+    }
+    static bool onMessage(void *context, TotemBUS::Message message) {
+        static_cast<Endpoint*>(context)->received++;
+        return true;
+    }
+};
+
+// Send round of messages, then receive all of them
+static Bench::Result sendRound(Endpoint &sender, Endpoint &receiver, TotemBUS::Frame &frame, UDPTransport *flush) {
+    Bench::Result result;
+    uint64_t received = receiver.received;
+    uint64_t packets = receiver.packets;
+    for (int i=0; i<ROUND; i++) {
+        Bench::check(frame.send(sender.bus, NUMBER, SERIAL), "Transport send");
+    }
+    if (flush) flush->flush();
+    for (int wait=0; receiver.received - received < ROUND && wait < 100; wait++) {
+        receiver.transport.transportPoll(10);
+    }
+    result.messages = receiver.received - received;
+    result.frames = receiver.packets - packets;
+    Bench::check(result.messages == ROUND, "Transport delivered all messages");
+    return result;
+}
+
+// Receiver polls in own thread while sender produces
+static Bench::Result sendThreaded(Endpoint &sender, Endpoint &receiver, TotemBUS::Frame &frame, double seconds) {
+    volatile bool running = true;
+    std::thread worker([&]() {
+        while (running) receiver.transport.transportPoll(10);
+    });
+    uint64_t sent = 0;
+    Bench::Result result = Bench::run([&]() {
+        Bench::Result round;
+        for (int i=0; i<ROUND; i++) frame.send(sender.bus, NUMBER, SERIAL);
+        sent += ROUND;
+        std::this_thread::yield();
+        return round;
+    }, seconds);
+    for (int wait=0; receiver.received < sent && wait < 100; wait++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    running = false;
+    worker.join();
+    Bench::check(receiver.received == sent, "Threaded transport delivered all messages");
+    result.messages = receiver.received;
+    result.frames = receiver.packets;
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.2;
+    std::string str16(16, 'a');
+    uint32_t cmd = "motorA"_cmd;
+    struct Case {
+        const char *name;
+        TotemBUS::Frame frame;
+    } cases[] = {
+        {"write int8", TotemBUS::write(cmd, 100)},
+        {"write string 16B", TotemBUS::write(cmd, {str16.c_str(), (uint32_t)str16.length()})},
+    };
+    printf("TotemBUS transport benchmark (%.2fs per case, %d messages per round)\n", seconds, ROUND);
+
+    Bench::header("LoopbackTransport");
+    for (auto &test : cases) {
+        LoopbackTransport linkA, linkB(linkA);
+        Endpoint sender(linkA), receiver(linkB);
+        Bench::report(test.name, Bench::run([&]() { return sendRound(sender, receiver, test.frame, nullptr); }, seconds));
+    }
+
+    Bench::header("LoopbackTransport receiver thread");
+    for (auto &test : cases) {
+        LoopbackTransport linkA, linkB(linkA);
+        Endpoint sender(linkA), receiver(linkB);
+        Bench::report(test.name, sendThreaded(sender, receiver, test.frame, seconds));
+    }
+
+    for (bool autoFlush : {true, false}) {
+        Bench::header(autoFlush ? "UDPTransport localhost (sendmmsg per message)"
+            : "UDPTransport localhost (sendmmsg per round)");
+        for (auto &test : cases) {
+            UDPTransport *linkA = new UDPTransport();
+            UDPTransport *linkB = new UDPTransport();
+            Bench::check(linkB->begin(0), "UDP bind");
+            Bench::check(linkA->begin(0, "127.0.0.1", linkB->getLocalPort()), "UDP bind");
+            linkA->setAutoFlush(autoFlush);
+            Endpoint sender(*linkA), receiver(*linkB);
+            Bench::report(test.name, Bench::run([&]() {
+                return sendRound(sender, receiver, test.frame, autoFlush ? nullptr : linkA);
+            }, seconds));
+            // Receiver learns address of sender and can respond
+            Bench::check(TotemBUS::respond(cmd, 1).send(receiver.bus, NUMBER, SERIAL), "UDP response");
+            uint64_t responses = sender.received;
+            for (int wait=0; sender.received == responses && wait < 100; wait++) linkA->transportPoll(10);
+            Bench::check(sender.received == responses + 1, "UDP response received");
+            delete linkA;
+            delete linkB;
+        }
+    }
+
+    // Datagrams hold whole messages only. Read with plain socket
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(local);
+        Bench::check(fd >= 0 && bind(fd, (sockaddr*)&local, sizeof(local)) == 0
+            && getsockname(fd, (sockaddr*)&local, &length) == 0, "UDP bind");
+        UDPTransport link;
+        Bench::check(link.begin(0, "127.0.0.1", ntohs(local.sin_port)), "UDP bind");
+        link.setAutoFlush(false);
+        Endpoint sender(link);
+        TotemBUS::Frame &frame = cases[1].frame;
+        size_t messagePackets = 0;
+        {
+            TotemBUSProtocol::Writer writer(frame.data, NUMBER, SERIAL);
+            messagePackets = writer.getPacketCount();
+        }
+        for (int i=0; i<ROUND; i++) frame.send(sender.bus, NUMBER, SERIAL);
+        link.flush();
+        size_t packets = 0;
+        bool whole = true;
+        uint8_t datagram[UDPTransport::DatagramSize];
+        pollfd descriptor = {fd, POLLIN, 0};
+        while (packets < ROUND * messagePackets && poll(&descriptor, 1, 100) > 0) {
+            ssize_t size = recv(fd, datagram, sizeof(datagram), 0);
+            if (size <= 0) break;
+            ByteBuffer stream(datagram, size);
+            ::CanPacket packet;
+            size_t count = 0;
+            while (::CanPacket::fromPackedStream(stream, packet)) count++;
+            whole = whole && (count % messagePackets) == 0;
+            packets += count;
+        }
+        Bench::check(whole && packets == ROUND * messagePackets, "UDP datagrams hold whole messages");
+        close(fd);
+    }
+    return 0;
+}
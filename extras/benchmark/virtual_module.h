@@ -0,0 +1,216 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef EXTRAS_BENCHMARK_VIRTUAL_MODULE
+#define EXTRAS_BENCHMARK_VIRTUAL_MODULE
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "core/TotemBUS.h"
+#include "lib/TotemTransport.h"
+
+namespace Bench {
+
+// Simulated Totem module. Keeps register map, answers writes, reads, pings
+// and sends subscribed registers at configured interval.
+class VirtualModule {
+public:
+    VirtualModule(uint16_t number, uint16_t serial) : number(number), serial(serial) { }
+    uint16_t getNumber() { return number; }
+    uint16_t getSerial() { return serial; }
+    void set(uint32_t command, int32_t value) {
+        registers[command] = value;
+    }
+    bool get(uint32_t command, int32_t &value) {
+        auto found = registers.find(command);
+        if (found == registers.end()) return false;
+        value = found->second;
+        return true;
+    }
+    uint64_t getWrites() { return writes; }
+
+    // Answer message addressed to this module
+    void process(TotemBUS &bus, TotemBUS::Message &message) {
+        switch (message.type) {
+        case TotemBUS::MessageType::RequestPing:
+            TotemBUS::respondPing(message.value).send(bus, number, serial);
+            return;
+        case TotemBUS::MessageType::RequestCapabilities:
+            // Old firmware does not respond
+            if (capabilities != 0) TotemBUS::respondCapabilities(capabilities).send(bus, number, serial);
+            return;
+        case TotemBUS::MessageType::WriteCommand:
+            writes++;
+            break;
+        case TotemBUS::MessageType::WriteValue:
+            set(message.command, message.value);
+            writes++;
+            break;
+        case TotemBUS::MessageType::WriteString:
+            set(message.command, message.string.length);
+            writes++;
+            break;
+        case TotemBUS::MessageType::WriteBatch: {
+            TotemBUSProtocol::String items = message.string;
+            uint32_t command;
+            int32_t value;
+            while (TotemBUS::Batch::readItem(items, command, value)) {
+                set(command, value);
+                writes++;
+            }
+            break;
+        }
+        case TotemBUS::MessageType::ReadCommand:
+        case TotemBUS::MessageType::RequestValue: {
+            int32_t value;
+            if (get(message.command, value))
+                TotemBUS::respond(message.command, value).send(bus, number, serial);
+            else
+                TotemBUS::respondStatus(message.command, false, 1).send(bus, number, serial);
+            return;
+        }
+        case TotemBUS::MessageType::Subscribe:
+            subscribe(message.command, message.value);
+            break;
+        default:
+            return;
+        }
+        if (message.responseReq)
+            TotemBUS::respondStatus(message.command, true).send(bus, number, serial);
+    }
+    // Send subscribed registers that are due. Returns amount of sent values
+    int tick(TotemBUS &bus, uint32_t now) {
+        int sent = 0;
+        for (auto &sub : subscriptions) {
+            if ((int32_t)(now - sub.next) < 0) continue;
+            sub.next = now + sub.interval;
+            int32_t value = 0;
+            get(sub.command, value);
+            TotemBUS::respond(sub.command, value).send(bus, number, serial);
+            sent++;
+        }
+        return sent;
+    }
+    // Capabilities responded to negotiation. [0] old firmware
+    void setCapabilities(uint8_t flags) {
+        capabilities = flags;
+    }
+private:
+    struct Subscription {
+        uint32_t command;
+        uint32_t interval;
+        uint32_t next;
+    };
+    uint16_t number;
+    uint16_t serial;
+    uint8_t capabilities = 0;
+    uint64_t writes = 0;
+    std::unordered_map<uint32_t, int32_t> registers;
+    std::vector<Subscription> subscriptions;
+
+    // Interval in ms. Negative - unsubscribe
+    void subscribe(uint32_t command, int32_t interval) {
+        for (size_t i=0; i<subscriptions.size(); i++) {
+            if (subscriptions[i].command != command) continue;
+            if (interval < 0) subscriptions.erase(subscriptions.begin() + i);
+            else subscriptions[i].interval = interval;
+            return;
+        }
+        if (interval >= 0) subscriptions.push_back({command, (uint32_t)interval, 0});
+    }
+};
+
+// Many VirtualModules sharing single transport endpoint
+class VirtualBus : public TotemLib::TotemTransport::Receiver {
+    TotemBUS::Memory<32, 256> memory;
+    TotemBUS bus;
+    TotemLib::TotemTransport &transport;
+    std::unordered_map<uint32_t, VirtualModule*> modules;
+    std::vector<VirtualModule*> list;
+    std::thread worker;
+    std::atomic<bool> running = {false};
+public:
+    VirtualBus(TotemLib::TotemTransport &transport) :
+    bus(memory, this, onCANSend, onMessage),
+    transport(transport) {
+        bus.setCANSendBatch(onCANSendBatch);
+        transport.setReceiver(this);
+    }
+    ~VirtualBus() {
+        stop();
+        transport.setReceiver(nullptr);
+        for (auto module : list) delete module;
+    }
+    VirtualModule& add(uint16_t number, uint16_t serial) {
+        VirtualModule *module = new VirtualModule(number, serial);
+        modules[key(number, serial)] = module;
+        list.push_back(module);
+        return *module;
+    }
+    VirtualModule* find(uint16_t number, uint16_t serial) {
+        auto found = modules.find(key(number, serial));
+        return found == modules.end() ? nullptr : found->second;
+    }
+    std::vector<VirtualModule*>& getModules() {
+        return list;
+    }
+    // Receive requests and send due subscriptions
+    void poll(int timeout, uint32_t now) {
+        transport.transportPoll(timeout);
+        for (auto module : list) module->tick(bus, now);
+    }
+    // Run poll() in own thread. "now" is taken from provided clock
+    template <typename Clock>
+    void start(Clock clock) {
+        running = true;
+        worker = std::thread([this, clock]() {
+            while (running) poll(1, clock());
+        });
+    }
+    void stop() {
+        running = false;
+        if (worker.joinable()) worker.join();
+    }
+private:
+    static uint32_t key(uint16_t number, uint16_t serial) {
+        return number | ((uint32_t)serial << 16);
+    }
+    void onTransportReceive(uint32_t id, uint8_t *data, uint8_t len) override {
+        bus.processCAN(id, data, len);
+    }
+    void dispatch(TotemBUS::Message &message) {
+        if (message.serial != 0) {
+            VirtualModule *module = find(message.number, message.serial);
+            if (module) module->process(bus, message);
+            return;
+        }
+        // Serial 0 addresses all modules with number. Number 0 - every module
+        for (auto module : list) {
+            if (message.number == 0 || module->getNumber() == message.number)
+                module->process(bus, message);
+        }
+    }
+    static bool onCANSend(void *context, TotemBUSProtocol::CanPacket &packet) {
+        return static_cast<VirtualBus*>(context)->transport.transportSend(&packet, 1);
+    }
+    static bool onCANSendBatch(void *context, TotemBUS::PacketBatch &batch) {
+        return static_cast<VirtualBus*>(context)->transport.transportSend(batch.packets, batch.count);
+    }
+    static bool onMessage(void *context, TotemBUS::Message message) {
+        if (message.type == TotemBUS::MessageType::ResponsePing) return true;
+        static_cast<VirtualBus*>(context)->dispatch(message);
+        return true;
+    }
+};
+
+} // namespace Bench
+
+#endif /* EXTRAS_BENCHMARK_VIRTUAL_MODULE */
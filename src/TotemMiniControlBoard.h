@@ -20,10 +20,10 @@ public:
 
     /// @brief Set LED strip state (boards v1.4, v1.5)
     /// @param map [0:0b111111111111] LED state map
-    void setLED(uint16_t map) { ble.cmdWrite("leds", map); }
+    void setLED(uint16_t map) { ble.cmdWrite("leds"_cmd, map); }
     /// @brief Turn full brightness RGB mode (change color to take effect)
     /// @param state [true] full, [false] medium
-    void rgbBrightMode(bool state) { ble.cmdWrite("rgbAll/bright", state); }
+    void rgbBrightMode(bool state) { ble.cmdWrite("rgbAll/bright"_cmd, state); }
     /// @brief Check if board has RGB lights (revision 2.0)
     /// @return [true] has RGB, [false] has LED strip
     bool hasRGB() { return getRevision().equals("2.0"); }
@@ -20,33 +20,33 @@ public:
 
     /// @brief Spin servo C
     /// @param pos [-100:100]% position. [0] center
-    void servoSpinC(int pos) { ble.cmdWrite("servoC", pos); }
+    void servoSpinC(int pos) { ble.cmdWrite("servoC"_cmd, pos); }
     /// @brief Spin servo D
     /// @param pos [-100:100]% position. [0] center
-    void servoSpinD(int pos) { ble.cmdWrite("servoD", pos); }
+    void servoSpinD(int pos) { ble.cmdWrite("servoD"_cmd, pos); }
     /// @brief Spin all servo motors with single command
     /// @param motorA [-100:100]% position. [0] center
     /// @param motorB [-100:100]% position. [0] center
     /// @param motorC [-100:100]% position. [0] center
     /// @param motorD [-100:100]% position. [0] center
-    void servoSpinABCD(int motorA, int motorB, int motorC=0, int motorD=0) { ble.cmdWrite("servoABC", ((uint8_t)motorA)<<24|((uint8_t)motorB)<<16|((uint8_t)motorC)<<8|((uint8_t)motorD)); }
+    void servoSpinABCD(int motorA, int motorB, int motorC=0, int motorD=0) { ble.cmdWrite("servoABC"_cmd, ((uint8_t)motorA)<<24|((uint8_t)motorB)<<16|((uint8_t)motorC)<<8|((uint8_t)motorD)); }
 
     /// @brief Read button (BOOT) state
     /// @return [true] is pressed, [false] not pressed
-    bool getButton() { return ble.cmdReadValue("button"); }
+    bool getButton() { return ble.cmdReadValue("button"_cmd); }
 
     /// @brief Send function command A
     /// @param value [0:0xFFFFFFFF]
-    void functionA(int value) { ble.cmdWrite("functionA", value); }
+    void functionA(int value) { ble.cmdWrite("functionA"_cmd, value); }
     /// @brief Send function command B
     /// @param value [0:0xFFFFFFFF]
-    void functionB(int value) { ble.cmdWrite("functionB", value); }
+    void functionB(int value) { ble.cmdWrite("functionB"_cmd, value); }
     /// @brief Send function command C
     /// @param value [0:0xFFFFFFFF]
-    void functionC(int value) { ble.cmdWrite("functionC", value); }
+    void functionC(int value) { ble.cmdWrite("functionC"_cmd, value); }
     /// @brief Send function command D
     /// @param value [0:0xFFFFFFFF]
-    void functionD(int value) { ble.cmdWrite("functionD", value); }
+    void functionD(int value) { ble.cmdWrite("functionD"_cmd, value); }
 
     /// @brief Send 32-bit value to remote board
     /// @param id identifier
@@ -69,6 +69,12 @@ public:
     /// @param id identifier
     /// @return [0:0xFFFFFFFF] value
     int readValue(uint32_t id) { return ble.cmdRequestValue(id); }
+    /// @brief Read multiple 32-bit values from remote board in single round trip
+    /// @param ids identifiers array
+    /// @param values array to store values. [0] if not received
+    /// @param count number of values [1:8]
+    /// @return [true] all received, [false] error
+    bool readValues(const uint32_t *ids, int *values, int count) { return ble.cmdRequestValues(ids, values, count); }
     /// @brief Read string (text) from remote board
     /// @param id identifier
     /// @return String object
@@ -88,6 +94,14 @@ public:
     /// @param onString void onString(int id, String string, void *arg)
     /// @param arg pointer passed to function
     void addOnReceive(void (*onString)(int id, String string, void *arg), void *arg) { ble.addOnStringArg(onString, arg); }
+    /// @brief Register event to intercept large string sent from remote board in parts.
+    /// Called as data arrives, without buffering whole string
+    /// @param onStringChunk void onStringChunk(int id, const char *data, int len, int offset, int total)
+    void addOnReceive(void (*onStringChunk)(int id, const char *data, int len, int offset, int total)) { ble.addOnStringChunk(onStringChunk); }
+    /// @brief Register event to intercept large string sent from remote board in parts with "arg" pointer
+    /// @param onStringChunk void onStringChunk(int id, const char *data, int len, int offset, int total, void *arg)
+    /// @param arg pointer passed to function
+    void addOnReceive(void (*onStringChunk)(int id, const char *data, int len, int offset, int total, void *arg), void *arg) { ble.addOnStringChunkArg(onStringChunk, arg); }
 };
 
 #endif /* LIB_MODULE_TOTEM_ROBOBOARD_X3 */
@@ -27,6 +27,9 @@ struct ModuleData {
     bool is(const char *command) {
         return cmdHash == TotemBUS::hash(command);
     }
+    bool is(uint32_t command) {
+        return cmdHash == command;
+    }
     bool isInt() {
         return ptr == nullptr;
     }
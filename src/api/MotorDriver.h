@@ -52,6 +52,9 @@ public:
     }
     // Configure front left wheel motor
     void addFrontLeft(const char *command, int minPower, int maxPower, bool inverted = false) { 
+        addFrontLeft(TotemBUS::hash(command), minPower, maxPower, inverted);
+    }
+    void addFrontLeft(uint32_t command, int minPower, int maxPower, bool inverted = false) { 
         setABCDChannel(command, motors[FL]);
         motors[FL].minPower = minPower;
         motors[FL].maxPower = maxPower;
@@ -59,6 +62,9 @@ public:
     }
     // Configure front right wheel motor
     void addFrontRight(const char *command, int minPower, int maxPower, bool inverted = false) { 
+        addFrontRight(TotemBUS::hash(command), minPower, maxPower, inverted);
+    }
+    void addFrontRight(uint32_t command, int minPower, int maxPower, bool inverted = false) { 
         setABCDChannel(command, motors[FR]);
         motors[FR].minPower = minPower;
         motors[FR].maxPower = maxPower;
@@ -66,6 +72,9 @@ public:
     }
     // Configure rear left wheel motor
     void addRearLeft(const char *command, int minPower, int maxPower, bool inverted = false) { 
+        addRearLeft(TotemBUS::hash(command), minPower, maxPower, inverted);
+    }
+    void addRearLeft(uint32_t command, int minPower, int maxPower, bool inverted = false) { 
         setABCDChannel(command, motors[RL]);
         motors[RL].minPower = minPower;
         motors[RL].maxPower = maxPower;
@@ -73,6 +82,9 @@ public:
     }
     // Configure rear right wheel motor
     void addRearRight(const char *command, int minPower, int maxPower, bool inverted = false) { 
+        addRearRight(TotemBUS::hash(command), minPower, maxPower, inverted);
+    }
+    void addRearRight(uint32_t command, int minPower, int maxPower, bool inverted = false) { 
         setABCDChannel(command, motors[RR]);
         motors[RR].minPower = minPower;
         motors[RR].maxPower = maxPower;
@@ -80,8 +92,11 @@ public:
     }
     // Configure servo motor
     void addServo(size_t ch, const char *command, int minPos, int centerPos, int maxPos, bool inverted = false) {
+        addServo(ch, TotemBUS::hash(command), minPos, centerPos, maxPos, inverted);
+    }
+    void addServo(size_t ch, uint32_t command, int minPos, int centerPos, int maxPos, bool inverted = false) {
         if (ch > 2) return;
-        servos[ch].cmdHash = TotemBUS::hash(command);
+        servos[ch].cmdHash = command;
         servos[ch].minPos = minPos;
         servos[ch].centerPos = centerPos;
         servos[ch].maxPos = maxPos;
@@ -203,11 +218,11 @@ private:
         }
         // Update motors with single command
         if (singleCommand && powerChanged) {
-            module.write("motorABCD", *abcdPower.A, *abcdPower.B, *abcdPower.C, *abcdPower.D);
+            module.write("motorABCD"_cmd, *abcdPower.A, *abcdPower.B, *abcdPower.C, *abcdPower.D);
         }
         // Update motors with single command
         if (singleCommand && brakeChanged) {
-            module.write("motorABCD/brake", *abcdBrake.A, *abcdBrake.B, *abcdBrake.C, *abcdBrake.D);
+            module.write("motorABCD/brake"_cmd, *abcdBrake.A, *abcdBrake.B, *abcdBrake.C, *abcdBrake.D);
         }
     }
 
@@ -231,31 +246,31 @@ private:
         }
     }
 
-    void setABCDChannel(const char *command, Motor &motor) {
+    void setABCDChannel(uint32_t command, Motor &motor) {
         // Set commands
-        motor.cmdHashPower = TotemBUS::hash(command);
+        motor.cmdHashPower = command;
         motor.cmdHashBrake = 0;
         // Configure channels if belongs to "motorABCD" command
         switch (motor.cmdHashPower) {
-            case 0xaba01c49: //"motorA"
+            case "motorA"_cmd:
             abcdPower.A = &motor.powerComputed;
             abcdBrake.A = &motor.brakeComputed;
-            motor.cmdHashBrake = 0x9a486d7d; //"motorA/brake"
+            motor.cmdHashBrake = "motorA/brake"_cmd;
             break;
-            case 0xa8a01790: //"motorB"
+            case "motorB"_cmd:
             abcdPower.B = &motor.powerComputed;
             abcdBrake.B = &motor.brakeComputed;
-            motor.cmdHashBrake = 0x03ee3018; //"motorB/brake"
+            motor.cmdHashBrake = "motorB/brake"_cmd;
             break;
-            case 0xa9a01923: //"motorC"
+            case "motorC"_cmd:
             abcdPower.C = &motor.powerComputed;
             abcdBrake.C = &motor.brakeComputed;
-            motor.cmdHashBrake = 0xa984c117; //"motorC/brake"
+            motor.cmdHashBrake = "motorC/brake"_cmd;
             break;
-            case 0xaea02102: //"motorD"
+            case "motorD"_cmd:
             abcdPower.D = &motor.powerComputed;
             abcdBrake.D = &motor.brakeComputed;
-            motor.cmdHashBrake = 0x64a0ec5a; //"motorD/brake"
+            motor.cmdHashBrake = "motorD/brake"_cmd;
             break;
             default:
                 // Set to individual motor update if used other command
@@ -19,12 +19,20 @@
 #ifndef LIB_TOTEM_SRC_API_TOTEMMODULE
 #define LIB_TOTEM_SRC_API_TOTEMMODULE
 
+#include <atomic>
 #include <stdint.h>
 #include <string>
 
 #include "lib/ModuleControl.h"
 #include "api/ModuleData.h"
 
+#ifndef TOTEMMODULE_SHADOWS
+#define TOTEMMODULE_SHADOWS 8 // Subscribed values cached per module
+#endif
+#ifndef TOTEMMODULE_READ_STRING
+#define TOTEMMODULE_READ_STRING 256 // String returned by readWait() per task
+#endif
+
 namespace TotemLib {
 
 class TotemModule : public TotemLib::Module::Control {
@@ -33,6 +41,8 @@ public:
 
     TotemModule(uint16_t number, uint16_t serial, DataReceiver receiver) : Control(number, serial), receiver(receiver) { }
     TotemModule(uint16_t number, uint16_t serial = 0) : TotemModule(number, serial, nullptr) { }
+    // Stop dispatch before onModuleMessage() is destroyed
+    ~TotemModule() { getList().detach(*this); }
 
     bool write(const char *command) {
         return write(hashCmd(command));
@@ -50,6 +60,12 @@ public:
     bool write(const char *command, const uint8_t *bytes, uint32_t bytesCount) {
         return write(hashCmd(command), bytes, bytesCount);
     }
+    bool write(const char *command, int32_t value, TotemBUS::Priority priority, uint16_t deadline = 0) {
+        return write(hashCmd(command), value, priority, deadline);
+    }
+    bool write(const char *command, const std::string value, TotemBUS::Priority priority, uint16_t deadline = 0) {
+        return write(hashCmd(command), value, priority, deadline);
+    }
     bool write(const char *command, int8_t A, int8_t B, int8_t C, int8_t D) {
         return write(hashCmd(command), A, B, C, D);
     }
@@ -88,6 +104,15 @@ public:
     bool readWait(const char *command, ModuleData &result) {
         return readWait(hashCmd(command), result);
     }
+    bool readCached(const char *command, ModuleData &result, uint32_t maxAgeMs) {
+        return readCached(hashCmd(command), result, maxAgeMs);
+    }
+    bool getCached(const char *command, ModuleData &result, uint32_t maxAgeMs = 0) {
+        return getCached(hashCmd(command), result, maxAgeMs);
+    }
+    uint32_t getCachedTime(const char *command) {
+        return getCachedTime(hashCmd(command));
+    }
     bool subscribe(const char *command, int intervalMs = 0) {
         return subscribe(hashCmd(command), intervalMs);
     }
@@ -126,9 +151,27 @@ public:
     bool write(uint32_t command, int8_t A, int8_t B, int8_t C) {
         return moduleWrite(command, toValue(0, A, B, C), false);
     }
+    // Priority::Control is sent ahead of queued Bulk messages (e.g. long strings).
+    // Write is dropped if not sent within deadline (ms), e.g. outdated motor setpoint
+    bool write(uint32_t command, int32_t value, TotemBUS::Priority priority, uint16_t deadline = 0) {
+        return moduleWrite(command, value, false, priority, deadline);
+    }
+    bool write(uint32_t command, const std::string value, TotemBUS::Priority priority, uint16_t deadline = 0) {
+        return moduleWrite(command, {value.c_str(), value.length()}, false, priority, deadline);
+    }
+    // Write all commands of batch in single message
+    bool write(TotemBUS::Batch &batch) {
+        return moduleWrite(batch, false);
+    }
+    bool write(TotemBUS::Batch &batch, TotemBUS::Priority priority, uint16_t deadline = 0) {
+        return moduleWrite(batch, false, priority, deadline);
+    }
     bool writeWait(uint32_t command) {
         return moduleWrite(command, true);
     }
+    bool writeWait(TotemBUS::Batch &batch) {
+        return moduleWrite(batch, true);
+    }
     bool writeWait(uint32_t command, int32_t value) {
         return moduleWrite(command, value, true);
     }
@@ -148,32 +191,59 @@ public:
     bool writeWait(uint32_t command, int8_t A, int8_t B, int8_t C) {
         return moduleWrite(command, toValue(0, A, B, C), true);
     }
+    // Write values and wait for all acknowledgements. Writes are sent ahead
+    // without waiting for previous responses (TOTEMMODULE_WINDOW in flight)
+    bool writeWaitAll(const uint32_t *commands, const int32_t *values, int count) {
+        return moduleWriteAll(commands, values, count);
+    }
 
     bool read(uint32_t command) {
         return moduleRead(command, false);
     }
     ModuleData readWait(uint32_t command) {
-        response.command = command;
-        response.waiting = true;
-        bool succ = moduleRead(response.command, true);
-        if (!succ || response.waiting) {
-            ModuleData data(0, (uint8_t*)"", 0);
-            return data;
-        }
-        return response.data;
+        ModuleData data(0, (uint8_t*)"", 0);
+        readWait(command, data);
+        return data;
     }
+    // String of result is valid until next readWait() of the task
     bool readWait(uint32_t command, ModuleData &result) {
-        response.command = command;
-        response.waiting = true;
-        bool succ = moduleRead(response.command, true);
-        if (!succ || response.waiting) return false;
-        result = response.data;
+        static thread_local char buffer[TOTEMMODULE_READ_STRING];
+        int32_t value;
+        TotemBUSProtocol::String string;
+        if (!moduleReadWait(command, value, string, buffer, sizeof(buffer))) return false;
+        if (string.data == nullptr)
+            result = getModuleData(command, value);
+        else
+            result = getModuleData(command, string);
         return true;
     }
+    // Cached value is served if received within maxAgeMs, otherwise read from module
+    bool readCached(uint32_t command, ModuleData &result, uint32_t maxAgeMs) {
+        if (getCached(command, result, maxAgeMs)) return true;
+        return readWait(command, result);
+    }
+    // Last value of subscribed command. Fails if not received within maxAgeMs ([0] any age)
+    bool getCached(uint32_t command, ModuleData &result, uint32_t maxAgeMs = 0) {
+        int32_t value;
+        uint32_t time;
+        if (!readShadow(command, value, time)) return false;
+        if (maxAgeMs != 0 && (uint32_t)(millis() - time) > maxAgeMs) return false;
+        result = getModuleData(command, value);
+        return true;
+    }
+    // Time (millis) cached value was received. [0] not available
+    uint32_t getCachedTime(uint32_t command) {
+        int32_t value;
+        uint32_t time;
+        if (!readShadow(command, value, time)) return 0;
+        return time;
+    }
     bool subscribe(uint32_t command, int intervalMs = 0) {
+        trackSubscription(command, intervalMs);
         return moduleSubscribe(command, intervalMs, false);
     }
     bool subscribeWait(uint32_t command, int intervalMs = 0) {
+        trackSubscription(command, intervalMs);
         return moduleSubscribe(command, intervalMs, true);
     }
     bool unsubscribe(uint32_t command) {
@@ -200,22 +270,73 @@ private:
         ModuleData moduleData(command, reinterpret_cast<uint8_t*>(const_cast<char*>(string.data)), string.length);
         return moduleData;
     }
-    struct {
-        int command;
-        ModuleData data;
-        bool waiting;
-    } response;
     DataReceiver receiver = nullptr;
-    void onModuleMessage(int command, int value, TotemBUSProtocol::String string) override {
-
-        if (response.waiting && command == response.command) {
-            if (string.data == nullptr)
-                response.data = getModuleData(command, value);
-            else
-                response.data = getModuleData(command, string);
-            response.waiting = false; 
+    // Shadow registers of subscribed values. Updated by receive path, version
+    // is odd while writing (seqlock). [0] no value received yet
+    struct {
+        std::atomic<uint32_t> command;
+        std::atomic<int32_t> value;
+        std::atomic<uint32_t> time;
+        std::atomic<uint32_t> version;
+        std::atomic<bool> used;
+    } shadows[TOTEMMODULE_SHADOWS] = {};
+    void trackSubscription(uint32_t command, int intervalMs) {
+        int slot = -1;
+        for (int i=0; i<TOTEMMODULE_SHADOWS; i++) {
+            if (shadows[i].used && shadows[i].command == command) {
+                if (intervalMs < 0) shadows[i].used = false;
+                return;
+            }
+            if (slot < 0 && !shadows[i].used) slot = i;
         }
-        else if (this->receiver) {
+        // Not cached if table is full
+        if (intervalMs < 0 || slot < 0) return;
+        shadows[slot].version = 0;
+        shadows[slot].command = command;
+        shadows[slot].used = true;
+    }
+    // Single writer (receive path)
+    void writeShadow(uint32_t command, int32_t value) {
+        for (auto &shadow : shadows) {
+            if (!shadow.used || shadow.command != command) continue;
+            uint32_t version = shadow.version.load(std::memory_order_relaxed);
+            shadow.version.store(version + 1, std::memory_order_relaxed);
+            // Odd version is visible before payload
+            std::atomic_thread_fence(std::memory_order_release);
+            shadow.value.store(value, std::memory_order_relaxed);
+            shadow.time.store(millis(), std::memory_order_relaxed);
+            shadow.version.store(version + 2, std::memory_order_release);
+            return;
+        }
+    }
+    bool readShadow(uint32_t command, int32_t &value, uint32_t &time) {
+        for (auto &shadow : shadows) {
+            if (!shadow.used || shadow.command != command) continue;
+            uint32_t version;
+            do {
+                version = shadow.version.load(std::memory_order_acquire);
+                value = shadow.value.load(std::memory_order_relaxed);
+                time = shadow.time.load(std::memory_order_relaxed);
+                // Payload is loaded before version is checked again
+                std::atomic_thread_fence(std::memory_order_acquire);
+            } while ((version & 1) || version != shadow.version.load(std::memory_order_relaxed));
+            return version != 0;
+        }
+        return false;
+    }
+    void onModuleEventReceive(TotemBUS::Message message) override {
+        if (this->receiver == nullptr) return;
+        if (message.string.data == nullptr)
+            this->receiver(getModuleData(message.command, message.value));
+        else
+            this->receiver(getModuleData(message.command, message.string));
+    }
+    void onModuleMessage(int command, int value, TotemBUSProtocol::String string, bool waited) override {
+        if (string.data == nullptr) writeShadow(command, value);
+
+        if (!waited && this->receiver) {
+            // Receiver is called from network event poll
+            if (deferModuleEvent(command, value, string)) return;
             if (string.data == nullptr)
                 this->receiver(getModuleData(command, value));
             else
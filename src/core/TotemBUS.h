@@ -18,7 +18,14 @@
  */
 #ifndef LIB_TOTEM_SRC_CORE_TOTEMBUS
 #define LIB_TOTEM_SRC_CORE_TOTEMBUS
+#include <new>
 #include "TotemBUSProtocol.h"
+#ifndef TOTEMBUS_BATCH_FRAMES
+#define TOTEMBUS_BATCH_FRAMES 32 // Packets encoded on stack for batch send
+#endif
+#ifndef TOTEMBUS_PEERS_COUNT
+#define TOTEMBUS_PEERS_COUNT 8 // Modules with negotiated capabilities
+#endif
 #if __cplusplus < 201402L
 #define constexpr
 #endif
@@ -47,7 +54,13 @@ public:
         SendString,     
         RequestValue,   
         RequestString,  
+        WriteBatch,     
+        RequestCapabilities,  // Peer advertises capabilities. Respond with respondCapabilities()
+        ResponseCapabilities, // Capabilities of peer are negotiated
     };
+    // Reserved command of capability negotiation ("totembus/capabilities"_cmd).
+    // Old firmware does not know it and never responds with its value
+    static const uint32_t CapabilitiesCommand = 0x9276c90f;
     struct Message {
         MessageType type = MessageType::Undefined;
         uint16_t number = 0, serial = 0;
@@ -56,51 +69,167 @@ public:
         TotemBUSProtocol::String string = {nullptr, 0};
         bool responseReq = false;
     };
+    // Transmit queue class. Auto: single packet message is Control, longer is Bulk
+    enum class Priority : uint8_t {
+        Auto,
+        Control,
+        Bulk,
+    };
+    // Packets of single message
+    struct PacketBatch {
+        TotemBUSProtocol::CanPacket *packets = nullptr;
+        size_t count = 0;
+        Priority priority = Priority::Control;
+        // Queued batch may be replaced by newer one with same number, serial and command
+        bool coalesce = false;
+        // Drop if not sent within this time (ms). [0] no limit
+        uint16_t deadline = 0;
+        uint16_t number = 0, serial = 0;
+        uint32_t command = 0;
+    };
     using CallbackCANSend = bool (*)(void *context, TotemBUSProtocol::CanPacket &packet);
+    using CallbackCANSendBatch = bool (*)(void *context, PacketBatch &batch);
     using CallbackMessageReceive = bool (*)(void *context, TotemBUS::Message message);
+    using CallbackStringChunk = bool (*)(void *context, TotemBUS::Message message, uint32_t offset, uint32_t total);
     struct Frame {
         TotemBUSProtocol::Data data;
         bool isRequest = true;
+        Priority priority = Priority::Auto;
+        bool coalesce = false;
+        uint16_t deadline = 0;
         bool send(TotemBUS &totemBUS, uint32_t number, uint32_t serial) {
             if (data.isEmpty())
                 return totemBUS.sendPing(number, serial, data.valueInt, isRequest);
+            else if (data.isByte() && data.getByte() == (uint8_t)MessageType::WriteBatch)
+                return totemBUS.sendWriteBatch(number, serial, *this);
             else
-                return totemBUS.send(number, serial, data, isRequest);
+                return totemBUS.send(number, serial, *this);
         }
     private:
         Frame() {} 
         friend class TotemBUS;
     };
+    // Commands with values collected into single WriteBatch message.
+    // Item: command (4 bytes) and zigzag varint value (1-5 bytes)
+    class Batch {
+    public:
+        static const int ItemSize = 9;
+        Batch(uint8_t *buffer, uint16_t size) : buffer(buffer), size(size) { }
+        bool add(uint32_t command, int32_t value) {
+            if (length + ItemSize > size) return false;
+            for (int i=0; i<4; i++) {
+                buffer[length++] = (command >> (i*8)) & 0xFF;
+            }
+            uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+            do {
+                uint8_t byte = zigzag & 0x7F;
+                zigzag >>= 7;
+                buffer[length++] = byte | (zigzag ? 0x80 : 0);
+            } while (zigzag);
+            lastCommand = command;
+            count++;
+            return true;
+        }
+        void clear() {
+            length = 0;
+            count = 0;
+        }
+        uint16_t getCount() {
+            return count;
+        }
+        // Response to WriteBatch is received for last command
+        uint32_t getLastCommand() {
+            return lastCommand;
+        }
+        TotemBUSProtocol::String getItems() {
+            return {reinterpret_cast<const char*>(buffer), length};
+        }
+        // Take first item from WriteBatch message string
+        static bool readItem(TotemBUSProtocol::String &items, uint32_t &command, int32_t &value) {
+            if (items.length < 5) return false;
+            const uint8_t *data = reinterpret_cast<const uint8_t*>(items.data);
+            command = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+            uint32_t zigzag = 0;
+            uint32_t index = 4;
+            for (uint32_t shift = 0; ; shift += 7) {
+                if (index >= items.length || shift > 28) return false;
+                zigzag |= (uint32_t)(data[index] & 0x7F) << shift;
+                if ((data[index++] & 0x80) == 0) break;
+            }
+            value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            items.data += index;
+            items.length -= index;
+            return true;
+        }
+    private:
+        uint8_t *buffer;
+        uint16_t size;
+        uint16_t length = 0;
+        uint16_t count = 0;
+        uint32_t lastCommand = 0;
+    };
+    template <int itemsCount>
+    struct BatchMemory : public Batch {
+        static_assert(itemsCount * ItemSize <= 0xFF00, "Batch size larger than message");
+        uint8_t storage[itemsCount * ItemSize];
+        BatchMemory() : Batch(storage, sizeof(storage)) { }
+    };
 private:
     TotemBUS(void *context, CallbackCANSend canSender, CallbackMessageReceive messageReceiver) : 
     callbackContext(context),
     callbackCAN(canSender),
     callbackMessage(messageReceiver)
-    { }
+    { single.assignBuffer(singleBuffer, sizeof(singleBuffer)); }
 public:
     template <int readersCount, int readerBufferSize>
     struct Memory {
         static_assert(readerBufferSize <= 0xFFFF, "Reader size larger than 0xFFFF is not supported by protocol");
-        static_assert(readersCount < 20, "Too many readers. Missmached parameters?");
+        static_assert(readersCount <= TotemBUSProtocol::ReaderTable::MaxReaders, "Too many readers. Missmached parameters?");
+        static const int slotsCount = TotemBUSProtocol::ReaderTable::SlotCount<readersCount>::value;
         uint8_t buffer[readersCount][readerBufferSize];
         TotemBUSProtocol::Reader reader[readersCount];
+        uint8_t slot[slotsCount];
         Memory() {
             for (int i=0; i<readersCount; i++) {
                 reader[i].assignBuffer(buffer[i], readerBufferSize);
             }
         }
     };
+    // Readers without buffers. Buffer is leased from source while message is received
+    template <int readersCount>
+    struct LeasedMemory {
+        static_assert(readersCount <= TotemBUSProtocol::ReaderTable::MaxReaders, "Too many readers. Missmached parameters?");
+        static const int slotsCount = TotemBUSProtocol::ReaderTable::SlotCount<readersCount>::value;
+        TotemBUSProtocol::Reader reader[readersCount];
+        uint8_t slot[slotsCount];
+        TotemBUSProtocol::BufferSource source;
+        LeasedMemory(TotemBUSProtocol::BufferSource source) : source(source) { }
+    };
     struct MemoryContainer {
         TotemBUSProtocol::Reader *readerPtr = nullptr;
         size_t readerCnt = 0;
+        uint8_t *slotPtr = nullptr;
+        size_t slotCnt = 0;
+        TotemBUSProtocol::BufferSource source = {};
         MemoryContainer() { }
         template <int readersCount, int readerBufferSize>
         MemoryContainer(Memory<readersCount, readerBufferSize> &memory) :
         readerPtr(memory.reader),
-        readerCnt(readersCount) { }
-        MemoryContainer(TotemBUSProtocol::Reader *readers, size_t count) :
+        readerCnt(readersCount),
+        slotPtr(memory.slot),
+        slotCnt(Memory<readersCount, readerBufferSize>::slotsCount) { }
+        template <int readersCount>
+        MemoryContainer(LeasedMemory<readersCount> &memory) :
+        readerPtr(memory.reader),
+        readerCnt(readersCount),
+        slotPtr(memory.slot),
+        slotCnt(LeasedMemory<readersCount>::slotsCount),
+        source(memory.source) { }
+        MemoryContainer(TotemBUSProtocol::Reader *readers, size_t count, uint8_t *slots = nullptr, size_t slotsCount = 0) :
         readerPtr(readers),
-        readerCnt(count) { }
+        readerCnt(count),
+        slotPtr(slots),
+        slotCnt(slotsCount) { }
     };
     TotemBUS(MemoryContainer *memory, void *context, CallbackCANSend canSender, CallbackMessageReceive messageReceiver) : 
     TotemBUS(context, canSender, messageReceiver)
@@ -181,12 +310,24 @@ public:
         frame.data.setValue(interval);
         return frame;
     }
+    static Frame writeBatch(Batch &batch, bool responseReq = false) {
+        Frame frame;
+        frame.isRequest = true;
+        frame.data.setBit(responseReq);
+        frame.data.setByte((uint8_t)MessageType::WriteBatch);
+        frame.data.setCommand(batch.getLastCommand());
+        frame.data.setValue(batch.getItems());
+        return frame;
+    }
     static Frame respondPing(uint8_t data = 0) {
         Frame frame;
         frame.isRequest = false;
         frame.data.valueInt = data; 
         return frame;
     }
+    static Frame respondCapabilities(uint8_t flags) {
+        return respond(CapabilitiesCommand, flags);
+    }
     static Frame respond(uint32_t command, int32_t value) {
         Frame frame;
         frame.isRequest = false;
@@ -211,40 +352,56 @@ public:
             frame.data.setValue(error);
         return frame;
     }
+    // Decoding state is kept only in Readers of this instance.
+    // Each TotemBUS object can process packets independently from other tasks.
     TotemBUSProtocol::Result processCAN(uint32_t id, uint8_t *data, uint8_t len) {
-        TotemBUSProtocol::Reader *selectedReader = nullptr;
-        for (int i=0; i<readerCount; i++) {
-            if (reader[i].forModule(id)) {
-                selectedReader = &reader[i];
-                break;
-            }
-            if (!reader[i].isUsed())
-                selectedReader = &reader[i];
-        }
-        if (selectedReader == nullptr) {
-            return TotemBUSProtocol::Result::ERROR_BUF_OVERFLOW;
+        uint32_t streamKey = TotemBUSProtocol::Reader::getStreamKey(id);
+        // Single packet message is decoded without taking Reader from streams in
+        // flight. It drops unfinished stream of the same module and direction
+        if (TotemBUSProtocol::Reader::isSinglePacket(id)) {
+            TotemBUSProtocol::Reader *interrupted = readers.find(streamKey);
+            if (interrupted != nullptr) readers.release(*interrupted);
+            single.clear();
+            auto result = single.processCANPacket(id, data, len);
+            if (result != TotemBUSProtocol::Result::RECEIVED) return result;
+            return receive(single) ? TotemBUSProtocol::Result::OK : TotemBUSProtocol::Result::ERROR_APP;
         }
-        static uint8_t stackDepth = 0;
-        auto result = selectedReader->processCANPacket(id, data, len);
-        if (result == TotemBUSProtocol::Result::RECEIVED) {
-            TotemBUSProtocol::Packet packet(selectedReader->getPacketInfo());
-            return callbackMessage(callbackContext, encodeToMessage(
-                    packet.number(), packet.serial(), packet.isRequest(), packet.data()))
-            ? TotemBUSProtocol::Result::OK : TotemBUSProtocol::Result::ERROR_APP;
-        }
-        else if (result == TotemBUSProtocol::Result::ERROR_EXT_MISSING) {
-            if (stackDepth++ > 3) return TotemBUSProtocol::Result::ERROR_EXT_MISSING; 
-            processCAN(id, data, len);
+        auto result = TotemBUSProtocol::Result::ERROR_EXT_MISSING;
+        // Packet interrupting unfinished stream drops it. Then packet is
+        // processed once more as start of a new message
+        for (int attempt=0; attempt<2 && result == TotemBUSProtocol::Result::ERROR_EXT_MISSING; attempt++) {
+            TotemBUSProtocol::Reader *selectedReader = readers.acquire(streamKey);
+            if (selectedReader == nullptr) {
+                return TotemBUSProtocol::Result::ERROR_BUF_OVERFLOW;
+            }
+            result = selectedReader->processCANPacket(id, data, len);
+            if (result == TotemBUSProtocol::Result::RECEIVED
+            || result == TotemBUSProtocol::Result::RECEIVED_CHUNK) {
+                bool success = receive(*selectedReader);
+                if (result == TotemBUSProtocol::Result::RECEIVED)
+                    readers.release(*selectedReader);
+                return success ? TotemBUSProtocol::Result::OK : TotemBUSProtocol::Result::ERROR_APP;
+            }
+            // Stream is completed or dropped. Reader is free for other streams
+            if (!selectedReader->isUsed())
+                readers.release(*selectedReader);
         }
-        else if (result != TotemBUSProtocol::Result::OK) {
+        return result;
+    }
+    // Message received whole (native framing): CAN ID of first packet and data of all
+    // packets. Passed to Reader in packet sized parts
+    TotemBUSProtocol::Result processMessage(uint32_t id, uint8_t *data, uint16_t len) {
+        uint8_t size = (len > 8) ? 8 : len;
+        TotemBUSProtocol::Result result = processCAN(id, data, size);
+        id = TotemBUSProtocol::Reader::setType(id, TotemBUSProtocol::PacketType::CompoundExt);
+        for (uint16_t offset = size; offset < len; offset += size) {
+            size = (len - offset > 8) ? 8 : len - offset;
+            result = processCAN(id, data + offset, size);
         }
-        stackDepth = 0;
         return result;
     }
     void clear() {
-        for (int i=0; i<readerCount; i++) {
-            reader[i].clear();
-        }
+        readers.clear();
     }
     static Message encodeToMessage(uint16_t number, uint16_t serial, bool isRequest, TotemBUSProtocol::Data &data) {
         Message message;
@@ -283,37 +440,138 @@ public:
             case MessageType::SendString:
             case MessageType::RequestValue:
             case MessageType::RequestString:
+            case MessageType::WriteBatch:
                 break;
             default:
                 message.type = MessageType::Undefined;
                 break;
             }
         }
+        if (message.command == CapabilitiesCommand) {
+            if (message.type == MessageType::WriteValue) message.type = MessageType::RequestCapabilities;
+            else if (message.type == MessageType::ResponseValue) message.type = MessageType::ResponseCapabilities;
+        }
         return message;
     }
     void setMemory(MemoryContainer &memory) {
-        this->reader = memory.readerPtr;
-        this->readerCount = memory.readerCnt;
+        readers.assign(memory.readerPtr, memory.readerCnt, memory.slotPtr, memory.slotCnt, memory.source);
+    }
+    // Send all packets of a message with single callback instead of CallbackCANSend per packet
+    void setCANSendBatch(CallbackCANSendBatch batchSender) {
+        callbackCANBatch = batchSender;
+    }
+    // Receive value strings larger than Reader buffer in slices as packets arrive.
+    // Slice data is valid only during callback. Strings fitting buffer are
+    // received whole with CallbackMessageReceive
+    void setStringChunkReceiver(CallbackStringChunk chunkReceiver) {
+        callbackChunk = chunkReceiver;
+        readers.setStreaming(chunkReceiver != nullptr);
+    }
+    // Protocol extensions (TotemBUSProtocol::Capability) advertised by negotiate().
+    // Extension is used for module only after it responds with the same flag
+    void setCapabilities(uint8_t flags) {
+        capabilities = flags & 0xF;
+    }
+    // Advertise capabilities to module. Module supporting negotiation responds
+    // with MessageType::ResponseCapabilities, old firmware ignores it
+    bool negotiate(uint32_t number, uint32_t serial) {
+        Frame frame = write(CapabilitiesCommand, capabilities);
+        return frame.send(*this, number, serial);
+    }
+    // Store capabilities of module reached through other address. E.g. board
+    // connected directly and addressed as (0, 0). Limited to own capabilities
+    void setPeerCapabilities(uint16_t number, uint16_t serial, uint8_t flags) {
+        flags &= capabilities;
+        for (int i=0; i<peersCount; i++) {
+            if (peers[i].number == number && peers[i].serial == serial) {
+                peers[i].capabilities = flags;
+                return;
+            }
+        }
+        if (flags == 0) return;
+        // Replace oldest entry when full
+        int index = peersNext;
+        if (peersCount < TOTEMBUS_PEERS_COUNT) index = peersCount++;
+        else peersNext = (peersNext + 1) % TOTEMBUS_PEERS_COUNT;
+        Peer &peer = peers[index];
+        peer.number = number;
+        peer.serial = serial;
+        peer.capabilities = flags;
+    }
+    // Capabilities negotiated with module. Serial 0 - common to all modules with number
+    uint8_t getPeerCapabilities(uint16_t number, uint16_t serial) {
+        uint8_t flags = 0;
+        bool found = false;
+        for (int i=0; i<peersCount; i++) {
+            if (peers[i].number != number) continue;
+            if (serial != 0 && peers[i].serial != serial) continue;
+            flags = found ? (flags & peers[i].capabilities) : peers[i].capabilities;
+            found = true;
+        }
+        return flags;
     }
 private:
     void * const callbackContext;
     CallbackCANSend const callbackCAN;
     CallbackMessageReceive const callbackMessage;
-    TotemBUSProtocol::Reader *reader = nullptr;
-    uint8_t readerCount = 0;
+    CallbackCANSendBatch callbackCANBatch = nullptr;
+    CallbackStringChunk callbackChunk = nullptr;
+    TotemBUSProtocol::ReaderTable readers;
+    // Decodes single packet messages
+    TotemBUSProtocol::Reader single;
+    uint8_t singleBuffer[8];
+    struct Peer {
+        uint16_t number;
+        uint16_t serial;
+        uint8_t capabilities;
+    } peers[TOTEMBUS_PEERS_COUNT];
+    uint8_t peersCount = 0;
+    uint8_t peersNext = 0;
+    uint8_t capabilities = 0;
     static bool isValid(uint32_t number, uint32_t serial) {
         return (TotemBUSProtocol::Writer::isValidNumber(number)
         && TotemBUSProtocol::Writer::isValidSerial(serial));
     }
+    // Pass message received by reader to callback
+    bool receive(TotemBUSProtocol::Reader &reader) {
+        TotemBUSProtocol::Packet packet(reader.getPacketInfo());
+        Message message = encodeToMessage(
+            packet.number(), packet.serial(), packet.isRequest(), packet.data());
+        if (message.type == MessageType::RequestCapabilities || message.type == MessageType::ResponseCapabilities)
+            setPeerCapabilities(message.number, message.serial, message.value);
+        if (reader.isChunked())
+            return callbackChunk(callbackContext, message, reader.getChunkOffset(), reader.getChunkTotal());
+        return callbackMessage(callbackContext, message);
+    }
     bool sendPing(uint32_t number, uint32_t serial, uint8_t data, bool isRequest) {
         if (!isValid(number, serial)) return false;
         TotemBUSProtocol::CanPacket packet = TotemBUSProtocol::Writer::getPingPacket(number, serial, isRequest, data);
+        if (callbackCANBatch) {
+            PacketBatch batch;
+            batch.packets = &packet;
+            batch.count = 1;
+            return callbackCANBatch(callbackContext, batch);
+        }
         return callbackCAN(callbackContext, packet);
     }
-    bool send(uint32_t number, uint32_t serial, TotemBUSProtocol::Data &data, bool request) {
+    bool send(uint32_t number, uint32_t serial, Frame &frame) {
         if (!isValid(number, serial)) return false;
-        TotemBUSProtocol::Writer writer(data, number, serial);
-        writer.setRequest(request);
+        TotemBUSProtocol::Writer writer(frame.data, number, serial);
+        writer.setRequest(frame.isRequest);
+        writer.setCompact(getPeerCapabilities(number, serial) & TotemBUSProtocol::Capability::CompactValue);
+        if (callbackCANBatch) {
+            PacketBatch batch;
+            batch.priority = frame.priority;
+            batch.deadline = frame.deadline;
+            // Only messages identified by command can be replaced
+            if (frame.coalesce && frame.data.isCommandInt()) {
+                batch.coalesce = true;
+                batch.number = number;
+                batch.serial = serial;
+                batch.command = frame.data.commandInt;
+            }
+            return sendBatch(writer, batch);
+        }
         TotemBUSProtocol::CanPacket packet;
         bool result = true;
         while (writer.getCANPacket(packet)) {
@@ -321,6 +579,35 @@ private:
         }
         return result;
     }
+    // Module without Capability::WriteBatch receives items as separate messages
+    bool sendWriteBatch(uint32_t number, uint32_t serial, Frame &batchFrame) {
+        if (getPeerCapabilities(number, serial) & TotemBUSProtocol::Capability::WriteBatch)
+            return send(number, serial, batchFrame);
+        TotemBUSProtocol::String items = batchFrame.data.getValueStr();
+        uint32_t command;
+        int32_t value;
+        bool result = true;
+        while (Batch::readItem(items, command, value)) {
+            Frame frame = write(command, value, items.length == 0 && batchFrame.data.isBit());
+            frame.priority = batchFrame.priority;
+            frame.deadline = batchFrame.deadline;
+            if (!send(number, serial, frame)) result = false;
+        }
+        return result;
+    }
+    bool sendBatch(TotemBUSProtocol::Writer &writer, PacketBatch &batch) {
+        TotemBUSProtocol::CanPacket stackPackets[TOTEMBUS_BATCH_FRAMES];
+        uint16_t count = writer.getPacketCount();
+        if (batch.priority == Priority::Auto)
+            batch.priority = (count == 1) ? Priority::Control : Priority::Bulk;
+        batch.packets = (count <= TOTEMBUS_BATCH_FRAMES) ? stackPackets
+            : new (std::nothrow) TotemBUSProtocol::CanPacket[count];
+        if (batch.packets == nullptr) return false;
+        batch.count = writer.getCANPackets(batch.packets, count);
+        bool result = callbackCANBatch(callbackContext, batch);
+        if (batch.packets != stackPackets) delete[] batch.packets;
+        return result;
+    }
 private:
     static constexpr uint32_t fnv1a32Hash(const char *cmd, uint32_t len) {
         uint32_t hash = 2166136261;
@@ -337,4 +624,17 @@ private:
     }
 };
 #undef constexpr
+namespace TotemBUSProtocol {
+// FNV-1a hash evaluated at compile time (C++11). Matches TotemBUS::hash()
+constexpr uint32_t hashLiteral(const char *cmd, size_t len, uint32_t hash = 2166136261U) {
+    return (len == 0 || *cmd == '\0') ? hash
+    : hashLiteral(cmd+1, len-1, (hash ^ (uint32_t)*cmd) * 16777619U);
+}
+}
+// Command hash computed at compile time. Usage: module.write("motorA"_cmd, 100)
+constexpr uint32_t operator"" _cmd(const char *cmd, size_t len) {
+    return TotemBUSProtocol::hashLiteral(cmd, len);
+}
+static_assert("motorA"_cmd == 0xaba01c49, "Command hash literal mismatch");
+static_assert("totembus/capabilities"_cmd == TotemBUS::CapabilitiesCommand, "Capabilities command hash mismatch");
 #endif /* LIB_TOTEM_SRC_CORE_TOTEMBUS */
@@ -20,6 +20,9 @@
 #define LIB_TOTEM_SRC_CORE_TOTEMBUSPROTOCOL
 #include <stdint.h>
 #include <string.h>
+#ifndef TOTEMBUS_READER_IDLE_PACKETS
+#define TOTEMBUS_READER_IDLE_PACKETS 32 // Stream without packets for this many is idle
+#endif
 namespace TotemBUSProtocol {
 #define TOTEMBUS_V1_SUPPORT_ENABLED
 struct String {
@@ -30,6 +33,14 @@ enum class PacketType : uint8_t {
     Basic,       
     Compound,    
     CompoundExt, 
+    CompoundCompact, 
+};
+// Protocol extensions advertised with TotemBUS::negotiate(). Used only if both sides support it
+struct Capability {
+    static const uint8_t CompactValue = 0x01; // 2 and 3 byte values, varint lengths
+    static const uint8_t WriteBatch   = 0x02; // TotemBUS::MessageType::WriteBatch
+    static const uint8_t PackedStreamV2 = 0x04; // BLE CAN tunnel packed stream v2 (CanPacket::StreamV2)
+    static const uint8_t NativeFraming  = 0x08; // BLE writes carry whole messages (TotemCANbus::MessageStream)
 };
 struct Flags {
     static const uint8_t Bit     = 0b10000000; 
@@ -203,6 +214,7 @@ private:
 enum class Result {
     OK,
     RECEIVED,             
+    RECEIVED_CHUNK,       
     ERROR_PROTOCOL,       
     ERROR_EXT_MISSING,    
     ERROR_EXT_RECEIVED,   
@@ -220,11 +232,12 @@ class Reader {
     static const uint32_t TypePkt     = 0x00000600UL;
     static const uint32_t RequestPkt  = 0x00000100UL;
     struct ReadStream {
-        uint8_t *buffer;
-        uint16_t bufferSize;
+        uint8_t *buffer    = nullptr;
+        uint16_t bufferSize = 0;
         uint16_t fill      = 0;
         uint16_t index     = 0;
         bool success  = true;
+        bool active   = false;
         uint16_t remaining() {
             return fill-index;
         }
@@ -232,13 +245,23 @@ class Reader {
             fill = 0;
             index = 0;
             success = true;
+            active = false;
         }
     } stream;
     uint16_t dataSize;
     uint16_t commandLength;
     uint16_t valueLength;
+    uint8_t valueBytes;
     PacketInfo info;
     bool discardExtended = false;
+    bool streaming = false;
+    bool chunked = false;
+    uint16_t prefixSize = 0;
+    uint16_t chunkOffset = 0;
+    uint16_t chunkNext = 0;
+    uint32_t streamKey = 0;
+    uint32_t streamAge = 0;
+    friend class ReaderTable;
 public:
     void assignBuffer(uint8_t *buffer, size_t size) {
         stream.buffer = buffer;
@@ -246,6 +269,12 @@ public:
     }
     void clear() {
         stream.reset();
+        discardExtended = false;
+    }
+    // Pass value string not fitting buffer in slices (RECEIVED_CHUNK).
+    // Last slice is returned as RECEIVED
+    void setStreaming(bool enable) {
+        streaming = enable;
     }
     Result processCANPacket(uint32_t id, uint8_t *data, uint8_t len) {
         if (!Packet::isV2(id))
@@ -262,14 +291,14 @@ public:
             info.dataInUse = true;
             stream.reset();
         }
-        else if (result != Result::OK) {
+        else if (result != Result::OK && result != Result::RECEIVED_CHUNK) {
             discardExtended = true;
             stream.reset();
         }
         return result;
     }
     bool isUsed() {
-        return stream.fill != 0;
+        return stream.active;
     }
     bool forModule(uint32_t CANid) {
         if (!isUsed()) return false;
@@ -279,6 +308,16 @@ public:
     PacketInfo& getPacketInfo() {
         return info;
     }
+    // Received value string is a slice at getChunkOffset() of getChunkTotal() length string
+    bool isChunked() {
+        return chunked;
+    }
+    uint16_t getChunkOffset() {
+        return chunkOffset;
+    }
+    uint16_t getChunkTotal() {
+        return valueLength;
+    }
     static bool isExtendedCAN(uint32_t id) {
         return (id & EXT) != 0;
     }
@@ -288,12 +327,19 @@ public:
     static bool isCompoundExt(uint32_t id) {
         return getType(id) == PacketType::CompoundExt;
     }
+    // Whole message is in this packet (ping or Basic)
+    static bool isSinglePacket(uint32_t id) {
+        return isRTRCAN(id) || getType(id) == PacketType::Basic;
+    }
     static bool isRequest(uint32_t id) {
         return !isExtendedCAN(id) || (id & RequestPkt) != 0;
     }
     static PacketType getType(uint32_t id) {
         return (PacketType)((id & TypePkt) >> 9);
     }
+    static uint32_t setType(uint32_t id, PacketType type) {
+        return (id & ~TypePkt) | (((uint32_t)type & 0xFF) << 9);
+    }
     static uint16_t readModuleNumber(uint32_t id) {
         return id & 0x0FF;
     }
@@ -301,13 +347,20 @@ public:
         if ((id & EXT) == 0) return 0;
         return ((id & 0x1FFFC000) >> 14);
     }
+    // Identifier of message stream: module number, serial and direction
+    static uint32_t getStreamKey(uint32_t id) {
+        return readModuleNumber(id)
+        | ((uint32_t)readModuleSerial(id) << 8)
+        | (isRequest(id) ? (1UL << 23) : 0);
+    }
 private:
     Result process(uint32_t id, uint8_t *data, uint8_t len) {
-        if (stream.fill == 0) {
+        if (!stream.active) {
             info.data.flags.setAll(0);
             info.number = readModuleNumber(id);
             info.serial = readModuleSerial(id);
             info.isRequest = isRequest(id);
+            chunked = false;
             if (isRTRCAN(id)) {
                 info.data.valueInt = len; 
                 return Result::RECEIVED;
@@ -320,15 +373,31 @@ private:
                 if (!readCompoundHeader())
                     return Result::ERROR_COMPOUND;
             }
+            else if (getType(id) == PacketType::CompoundCompact) {
+                if (!readCompactHeader())
+                    return Result::ERROR_COMPOUND;
+            }
             else {
                 return Result::ERROR_EXT_RECEIVED;
             }
             len -= stream.index;
             data += stream.index;
             stream.reset();
+            stream.active = true;
+            if (streaming && info.data.flags.is(Flags::ValStr) && dataSize > stream.bufferSize) {
+                if (dataSize <= valueLength)
+                    return Result::ERROR_COMPOUND;
+                prefixSize = dataSize - valueLength - 1;
+                if (prefixSize > stream.bufferSize)
+                    return Result::ERROR_BUF_OVERFLOW;
+                chunkNext = 0;
+                chunked = true;
+            }
         }
-        if (stream.fill != 0 && getType(id) != PacketType::CompoundExt)
+        else if (getType(id) != PacketType::CompoundExt)
             return Result::ERROR_EXT_MISSING;
+        if (chunked)
+            return processChunk(data, len);
         if (stream.fill + len > (int)stream.bufferSize)
             return Result::ERROR_BUF_OVERFLOW;
         memcpy(&stream.buffer[stream.fill], data, len);
@@ -343,15 +412,46 @@ private:
         }
         return Result::OK;
     }
+    // Buffer fields preceding value string. Value string is not copied,
+    // slice points to CAN packet data
+    Result processChunk(uint8_t *data, uint8_t len) {
+        if (stream.fill < prefixSize) {
+            uint16_t size = prefixSize - stream.fill;
+            if (size > len) size = len;
+            memcpy(&stream.buffer[stream.fill], data, size);
+            stream.fill += size;
+            data += size;
+            len -= size;
+            if (stream.fill < prefixSize)
+                return Result::OK;
+            if (!parse(false))
+                return Result::ERROR_DATA_UNDERFLOW;
+        }
+        uint32_t left = valueLength + 1UL - chunkNext;
+        if (len > left)
+            return Result::ERROR_DATA_OVERFLOW;
+        if (len == 0)
+            return Result::OK;
+        bool last = (len == left);
+        if (last && data[len-1] != '\0')
+            return Result::ERROR_DATA_UNDERFLOW;
+        info.data.valueStr.data = (char*)data;
+        info.data.valueStr.length = last ? len-1 : len;
+        chunkOffset = chunkNext;
+        chunkNext += info.data.valueStr.length;
+        return last ? Result::RECEIVED : Result::RECEIVED_CHUNK;
+    }
     bool readPacketBasic() {
-        if (stream.remaining() == 8)
-            info.data.flags.set(Flags::SizeEx);
-        else if (stream.remaining() != 5)
+        // 5 and 8 bytes packets are legacy. 6 and 7 - CompactValue
+        if (stream.remaining() < 5 || stream.remaining() > 8)
             return false;
+        valueBytes = stream.remaining() - 4;
+        if (valueBytes > 1)
+            info.data.flags.set(Flags::SizeEx);
         info.data.flags.set(Flags::CmdInt);
         info.data.flags.set(Flags::ValInt);
         info.data.commandInt = readValue(stream, 4);
-        info.data.valueInt = readValue(stream, info.data.flags.is(Flags::SizeEx)? 4 : 1);
+        info.data.valueInt = readSigned(stream, valueBytes);
         return stream.success;
     }
     bool readCompoundHeader() {
@@ -370,19 +470,48 @@ private:
             dataSize = readValue(stream, bytesCount);
         else
             dataSize = stream.remaining();
+        valueBytes = info.data.flags.is(Flags::SizeEx)? 4 : 1;
         return stream.success;
     }
-    bool parse() {
+    // Lengths are varint. Value size is what is left of data
+    bool readCompactHeader() {
+        info.data.flags.setAll(readValue(stream, 1));
+        if (info.data.flags.is(Flags::Byte)) {
+            info.data.dataByte = readValue(stream, 1);
+        }
+        if (info.data.flags.is(Flags::CmdStr)) {
+            commandLength = readVarint(stream);
+        }
+        if (info.data.flags.is(Flags::ValStr)) {
+            valueLength = readVarint(stream);
+        }
+        if (info.data.flags.is(Flags::Extends))
+            dataSize = readVarint(stream);
+        else
+            dataSize = stream.remaining();
+        int32_t size = dataSize;
+        if (info.data.flags.is(Flags::CmdInt)) size -= 4;
+        if (info.data.flags.is(Flags::CmdStr)) size -= commandLength + 1;
+        if (info.data.flags.is(Flags::ValStr)) size -= valueLength + 1;
+        if (info.data.flags.is(Flags::ValInt) ? (size < 1 || size > 4) : (size != 0))
+            return false;
+        valueBytes = size;
+        info.data.flags.rem(Flags::SizeEx);
+        if (valueBytes > 1)
+            info.data.flags.set(Flags::SizeEx);
+        return stream.success;
+    }
+    bool parse(bool withValue = true) {
         if (info.data.flags.is(Flags::CmdInt)) {
             info.data.commandInt = readValue(stream, 4);
         }
         if (info.data.flags.is(Flags::ValInt)) {
-            info.data.valueInt = readValue(stream, info.data.flags.is(Flags::SizeEx)? 4 : 1);
+            info.data.valueInt = readSigned(stream, valueBytes);
         }
         if (info.data.flags.is(Flags::CmdStr)) {
             info.data.commandStr = readString(stream, commandLength);
         }
-        if (info.data.flags.is(Flags::ValStr)) {
+        if (info.data.flags.is(Flags::ValStr) && withValue) {
             info.data.valueStr = readString(stream, valueLength);
         }
         return stream.success;
@@ -398,6 +527,23 @@ private:
         else stream.success = false;
         return value;
     }
+    static int32_t readSigned(ReadStream &stream, uint32_t bytes) {
+        uint32_t shift = 32 - bytes * 8;
+        return (int32_t)(readValue(stream, bytes) << shift) >> shift;
+    }
+    static uint16_t readVarint(ReadStream &stream) {
+        uint32_t value = 0;
+        for (uint32_t shift = 0; shift < 21 && stream.success; shift += 7) {
+            uint32_t byte = readValue(stream, 1);
+            value |= (byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                if (value > 0xFFFF) break;
+                return value;
+            }
+        }
+        stream.success = false;
+        return 0;
+    }
     static String readString(ReadStream &stream, uint32_t length) {
         String str = {};
         if (stream.remaining() >= (length + 1)
@@ -411,6 +557,165 @@ private:
         return str;
     }
 };
+// Reader buffers taken from shared pool only while message is received.
+// lease() sets size to capacity of returned buffer. nullptr - none free
+struct BufferSource {
+    void *context;
+    uint16_t size;
+    uint8_t *(*lease)(void *context, uint16_t &size);
+    void (*release)(void *context, uint8_t *buffer);
+};
+// Table of Readers assigned to incoming message streams.
+// Stream (module number, serial, direction) is looked up in open addressing
+// hash table. Free Readers are tracked in a bit mask.
+// Age is counted in packets passed to acquire().
+class ReaderTable {
+    Reader *reader = nullptr;
+    uint8_t *slot = nullptr; // Reader index + 1. 0 - empty slot
+    uint64_t freeMask = 0;
+    uint32_t age = 0;
+    uint16_t slotMask = 0;
+    uint8_t count = 0;
+    bool streaming = false;
+    BufferSource source = {};
+public:
+    static const int MaxReaders = 64;
+    ~ReaderTable() {
+        if (source.release) clear();
+    }
+    template <int readersCount, int size = 1, bool done = (size >= readersCount*2)>
+    struct SlotCount {
+        static const int value = SlotCount<readersCount, size*2>::value;
+    };
+    template <int readersCount, int size>
+    struct SlotCount<readersCount, size, true> {
+        static const int value = size;
+    };
+    // Slots count must be power of 2 and at least twice the readers count.
+    // If slots are not provided, streams are looked up linearly.
+    // With buffer source, Readers get buffer when assigned to stream.
+    void assign(Reader *readers, uint8_t readersCount, uint8_t *slots = nullptr, uint16_t slotsCount = 0,
+        BufferSource bufferSource = {}) {
+        // Return buffers leased by previous Readers
+        clear();
+        reader = readers;
+        count = (readersCount > MaxReaders) ? MaxReaders : readersCount;
+        freeMask = allFree();
+        source = bufferSource;
+        slot = (slotsCount >= count*2 && (slotsCount & (slotsCount-1)) == 0) ? slots : nullptr;
+        slotMask = slot ? slotsCount-1 : 0;
+        setStreaming(streaming);
+        clear();
+    }
+    void setStreaming(bool enable) {
+        streaming = enable;
+        for (int i=0; i<count; i++) {
+            reader[i].setStreaming(enable);
+        }
+    }
+    void clear() {
+        for (int i=0; i<count; i++) {
+            if (!isFree(i)) releaseBuffer(reader[i]);
+            reader[i].clear();
+        }
+        if (slot) memset(slot, 0, slotMask+1);
+        freeMask = allFree();
+    }
+    // Find Reader assigned to stream
+    Reader* find(uint32_t key) {
+        if (slot == nullptr) {
+            for (int i=0; i<count; i++) {
+                if (!isFree(i) && reader[i].streamKey == key) return &reader[i];
+            }
+            return nullptr;
+        }
+        for (uint16_t i = hash(key); slot[i] != 0; i = (i+1) & slotMask) {
+            if (reader[slot[i]-1].streamKey == key) return &reader[slot[i]-1];
+        }
+        return nullptr;
+    }
+    // Find Reader assigned to stream or assign free one.
+    // If all Readers are busy, stream idle for TOTEMBUS_READER_IDLE_PACKETS
+    // is dropped. Otherwise new stream is not received.
+    Reader* acquire(uint32_t key) {
+        uint32_t now = age++;
+        Reader *found = find(key);
+        if (found != nullptr) {
+            found->streamAge = now;
+            return found;
+        }
+        if (count == 0) return nullptr;
+        if (freeMask == 0) {
+            int idle = oldest();
+            if (now - reader[idle].streamAge < TOTEMBUS_READER_IDLE_PACKETS) return nullptr;
+            release(reader[idle]);
+        }
+        int index = __builtin_ctzll(freeMask);
+        if (source.lease) {
+            uint16_t size = source.size;
+            uint8_t *buffer = source.lease(source.context, size);
+            if (buffer == nullptr) return nullptr;
+            reader[index].assignBuffer(buffer, size);
+        }
+        freeMask &= ~(1ULL << index);
+        reader[index].clear();
+        reader[index].streamKey = key;
+        reader[index].streamAge = now;
+        if (slot) {
+            uint16_t i = hash(key);
+            while (slot[i] != 0) i = (i+1) & slotMask;
+            slot[i] = index+1;
+        }
+        return &reader[index];
+    }
+    // Return Reader to free list
+    void release(Reader &released) {
+        int index = &released - reader;
+        if (index < 0 || index >= count || isFree(index)) return;
+        releaseBuffer(released);
+        freeMask |= (1ULL << index);
+        if (slot == nullptr) return;
+        uint16_t i = hash(released.streamKey);
+        while (slot[i] != index+1) {
+            if (slot[i] == 0) return;
+            i = (i+1) & slotMask;
+        }
+        // Shift following entries of the probe sequence back
+        for (uint16_t j = (i+1) & slotMask; slot[j] != 0; j = (j+1) & slotMask) {
+            uint16_t home = hash(reader[slot[j]-1].streamKey);
+            if (((j - home) & slotMask) >= ((j - i) & slotMask)) {
+                slot[i] = slot[j];
+                i = j;
+            }
+        }
+        slot[i] = 0;
+    }
+private:
+    bool isFree(int index) {
+        return (freeMask & (1ULL << index)) != 0;
+    }
+    uint64_t allFree() {
+        return (count == 64) ? ~0ULL : ((1ULL << count) - 1);
+    }
+    void releaseBuffer(Reader &released) {
+        if (source.release == nullptr || released.stream.buffer == nullptr) return;
+        source.release(source.context, released.stream.buffer);
+        released.assignBuffer(nullptr, 0);
+    }
+    int oldest() {
+        int index = 0;
+        for (int i=1; i<count; i++) {
+            if ((int32_t)(reader[i].streamAge - reader[index].streamAge) < 0) index = i;
+        }
+        return index;
+    }
+    uint16_t hash(uint32_t key) {
+        key ^= key >> 16;
+        key *= 0x45d9f3bUL;
+        key ^= key >> 16;
+        return key & slotMask;
+    }
+};
 struct CanPacket {
     uint32_t id;
     uint8_t data[8];
@@ -444,12 +749,45 @@ public:
     bool isRequest() {
         return (CANid & RequestPkt) != 0;
     }
+    // Encode with Capability::CompactValue. Receiver must support it
+    void setCompact(bool enable) {
+        compact = enable;
+    }
     bool getCANPacket(CanPacket &packet) {
         packet.len = prepareNextPacket(packet.data);
         packet.id = CANid;
         setPacketType(PacketType::CompoundExt);
         return packet.len != 0;
     }
+    // Write next packets of message to array. Returns amount of packets written
+    size_t getCANPackets(CanPacket *packets, size_t count) {
+        size_t written = 0;
+        while (written < count && getCANPacket(packets[written])) {
+            written++;
+        }
+        return written;
+    }
+    // Amount of packets required to send whole message
+    uint16_t getPacketCount() {
+        PacketType start = getStartType();
+        if (start == PacketType::Basic)
+            return 1;
+        uint32_t dataSize = getDataSize(start);
+        uint32_t header;
+        if (start == PacketType::CompoundCompact) {
+            header = getCompactHeaderSize();
+        }
+        else {
+            uint32_t sizeBytes = busData.flags.is(Flags::SizeEx) ? 2 : 1;
+            header = 1;
+            if (busData.flags.is(Flags::Byte)) header += 1;
+            if (busData.flags.is(Flags::CmdStr)) header += sizeBytes;
+            if (busData.flags.is(Flags::ValStr)) header += sizeBytes;
+            if (header + dataSize > 8) header += sizeBytes;
+        }
+        if (header + dataSize <= 8) return 1;
+        return 1 + (dataSize - (8 - header) + 7) / 8;
+    }
     static bool isValidNumber(uint32_t number) {
         return number <= 0x0FF;
     }
@@ -472,12 +810,53 @@ private:
     Data &busData;
     uint32_t CANid = 0;
     int8_t writeFunction = -1;
+    bool compact = false;
+    uint8_t valueBytes = 1;
     void setPacketType(PacketType type) {
         CANid = (CANid & ~TypePkt) | (((uint32_t)type & 0xFF) << 9);
     }
     PacketType getPacketType() {
         return (PacketType)((CANid & TypePkt) >> 9);
     }
+    // Type of first packet. Compact header not fitting single packet falls back to Compound
+    PacketType getStartType() {
+        if ((busData.flags.getAll() & ~Flags::SizeEx) == (Flags::CmdInt | Flags::ValInt))
+            return PacketType::Basic;
+        if (compact && getCompactHeaderSize() <= 8)
+            return PacketType::CompoundCompact;
+        return PacketType::Compound;
+    }
+    uint8_t getValueBytes(PacketType start) {
+        if (compact && start != PacketType::Compound)
+            return getCompactSize(busData.valueInt);
+        return busData.flags.is(Flags::SizeEx) ? 4 : 1;
+    }
+    uint16_t getDataSize(PacketType start) {
+        uint16_t dataSize = busData.getDataSize();
+        if (busData.flags.is(Flags::ValInt))
+            dataSize = dataSize - (busData.flags.is(Flags::SizeEx) ? 4 : 1) + getValueBytes(start);
+        return dataSize;
+    }
+    uint16_t getCompactHeaderSize() {
+        uint16_t header = 1;
+        if (busData.flags.is(Flags::Byte)) header += 1;
+        if (busData.flags.is(Flags::CmdStr)) header += getVarintSize(busData.commandStr.length);
+        if (busData.flags.is(Flags::ValStr)) header += getVarintSize(busData.valueStr.length);
+        uint16_t dataSize = getDataSize(PacketType::CompoundCompact);
+        if (header + dataSize > 8) header += getVarintSize(dataSize);
+        return header;
+    }
+    static uint8_t getCompactSize(int32_t value) {
+        if (-0x80 <= value && value <= 0x7F) return 1;
+        if (-0x8000 <= value && value <= 0x7FFF) return 2;
+        if (-0x800000 <= value && value <= 0x7FFFFF) return 3;
+        return 4;
+    }
+    static uint8_t getVarintSize(uint32_t value) {
+        uint8_t size = 1;
+        while (value >>= 7) size++;
+        return size;
+    }
     bool writeData(uint32_t function) {
         switch (function) {
         case 0: {
@@ -488,7 +867,7 @@ private:
         }
         case 1: {
             if (busData.flags.is(Flags::ValInt)) { 
-                return writeValue(stream, busData.valueInt, (busData.flags.is(Flags::SizeEx))? 4 : 1);
+                return writeValue(stream, busData.valueInt, valueBytes);
             }
             return true;
         }
@@ -512,12 +891,29 @@ private:
         stream.index = 0;
         if (writeFunction == -1) {
             stream.dataIndex = 0;
-            if ((busData.flags.getAll() & ~Flags::SizeEx) == (Flags::CmdInt | Flags::ValInt)) {
+            PacketType start = getStartType();
+            valueBytes = getValueBytes(start);
+            if (start == PacketType::Basic) {
                 setPacketType(PacketType::Basic);
                 writeValue(stream, busData.commandInt, 4);
-                writeValue(stream, busData.valueInt, (busData.flags.is(Flags::SizeEx))? 4 : 1);
+                writeValue(stream, busData.valueInt, valueBytes);
                 writeFunction = 5;
                 return stream.index;
+            } else if (start == PacketType::CompoundCompact) {
+                setPacketType(PacketType::CompoundCompact);
+                uint16_t dataSize = getDataSize(start);
+                writeValue(stream, busData.flags.getAll(), 1);
+                if (busData.flags.is(Flags::Byte))
+                    writeValue(stream, busData.dataByte, 1);
+                if (busData.flags.is(Flags::CmdStr))
+                    writeVarint(stream, busData.commandStr.length);
+                if (busData.flags.is(Flags::ValStr))
+                    writeVarint(stream, busData.valueStr.length);
+                if (stream.remaining() < dataSize) {
+                    busData.flags.set(Flags::Extends); 
+                    stream.buffer[0] = busData.flags.getAll(); 
+                    writeVarint(stream, dataSize);
+                }
             } else {
                 setPacketType(PacketType::Compound);
                 uint16_t dataSize = busData.getDataSize();
@@ -560,6 +956,13 @@ private:
         }
         return false;
     }
+    static void writeVarint(WriteStream &stream, uint32_t value) {
+        do {
+            uint8_t byte = value & 0x7F;
+            value >>= 7;
+            stream.buffer[stream.index++] = byte | (value ? 0x80 : 0);
+        } while (value);
+    }
     static bool writeString(WriteStream &stream, String &str) {
         for (; stream.dataIndex < str.length && stream.remaining() > 0; stream.inc())
             stream.buffer[stream.index] = str.data[stream.dataIndex];
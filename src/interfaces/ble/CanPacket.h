@@ -35,7 +35,20 @@ public:
             memcpy(this->data, data, this->length);
         }
     };
+    // Packed stream v2. Write starts with StreamV2 byte (standard packet length 14,
+    // never produced by v1). Each packet has 1 byte header [7:6] ID [5:4] reserved [3:0] length:
+    // ID: 00 - same as previous, 01 - previous + int8 delta, 11 - previous + int16 delta,
+    //     10 - full ID (4 bytes). First packet of write always has full ID
+    static const uint8_t StreamV2 = 0x77;
+    struct StreamState {
+        uint32_t id = 0;
+        bool started = false;
+    };
 private:
+    static const uint8_t V2_ID_SAME    = 0x00;
+    static const uint8_t V2_ID_DELTA8  = 0x40;
+    static const uint8_t V2_ID_FULL    = 0x80;
+    static const uint8_t V2_ID_DELTA16 = 0xC0;
     static const uint32_t CAN_ID_EXTENDED = 0x80000000;
     static const uint32_t CAN_ID_RTR      = 0x40000000;
 
@@ -74,10 +87,51 @@ public:
     bool arrayPacked(Data<13> &array) {
         return isExtended() ? writeExtendedPacket(array) : writeStandardPacket(array);
     }
+    bool arrayPacked(Data<13> &array, StreamState &state) {
+        ByteBuffer buffer(array.data, array.capacity);
+        int32_t delta = (int32_t)(_id - state.id);
+        uint8_t len = _len & 0x0F;
+        if (state.started && delta == 0) {
+            buffer.put(V2_ID_SAME | len);
+        } else if (state.started && delta >= INT8_MIN && delta <= INT8_MAX) {
+            buffer.put(V2_ID_DELTA8 | len);
+            buffer.put((uint8_t)delta);
+        } else if (state.started && delta >= INT16_MIN && delta <= INT16_MAX) {
+            buffer.put(V2_ID_DELTA16 | len);
+            buffer.putShort((uint16_t)delta);
+        } else {
+            buffer.put(V2_ID_FULL | len);
+            buffer.putInt(_id);
+        }
+        if (!isRTR()) {
+            buffer.put(_data.data, _data.length);
+        }
+        array.length = buffer.position();
+        if (buffer.isError()) return false;
+        state.id = _id;
+        state.started = true;
+        return true;
+    }
+    static bool fromPackedStream(ByteBuffer &stream, CanPacket &packet, StreamState &state) {
+        if (stream.remaining() == 0) return false;
+        uint8_t header = stream.get();
+        uint8_t idType = header & 0xC0;
+        if (!state.started && idType != V2_ID_FULL) return false;
+        uint32_t id = state.id;
+        if (idType == V2_ID_DELTA8) id += (int8_t)stream.get();
+        else if (idType == V2_ID_DELTA16) id += (int16_t)stream.getShort();
+        else if (idType == V2_ID_FULL) id = stream.getInt();
+        packet._id = id;
+        packet._len = header & 0x0F;
+        if (packet._len > 8 || stream.isError()) return false;
+        state.id = id;
+        state.started = true;
+        return stream.get(packet._data.data, packet.isRTR() ? 0 : packet._len);
+    }
     static bool fromPackedStream(ByteBuffer &stream, CanPacket &packet) {
         if (stream.remaining() == 0) return false;
         bool result;
-        if (isExtended(stream.get(0)))
+        if (isExtended(stream.get(stream.position())))
             result = packet.readExtendedPacket(stream);
         else
             result = packet.readStandardPacket(stream);
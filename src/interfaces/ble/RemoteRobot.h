@@ -33,6 +33,8 @@ public:
     canService(client, *this) 
     {
         client = BLEDevice::createClient(); 
+        // Queue is drained in batches. Pack them into MTU sized writes
+        canService.setCoalescing(true);
     }
     ~RemoteRobot() {
         delete client;
@@ -42,7 +44,7 @@ public:
         BLEDevice::getScan()->stop();
         bool result = client->connect(address, type);
         if (result) {
-            if (!canService.initService()) {
+            if (!openQueues() || !canService.initService()) {
                 client->disconnect();
                 return false;
             }
@@ -54,6 +56,10 @@ public:
     void reset() {
         moduleListMainReset();
     }
+    // Packets dropped because no transmit buffer was free in BufferArena
+    uint32_t getDroppedCount() {
+        return canService.getDroppedCount();
+    }
 private:
     // TotemNetwork:
     // TotemBUS request to send CAN packet to physical interface
@@ -61,12 +67,21 @@ private:
         // Send requested packet to CAN service
         canService.send(id, data, len);
     }
+    void onCANPacketsFlush() override {
+        canService.flush();
+    }
+    int32_t getFlushTimeout() override {
+        return canService.getFlushTimeout();
+    }
     // TotemCANService:
     // Received CAN packet from BLE CAN service
     void onServiceReceive(uint32_t id, uint8_t *data, uint8_t len) override {
         // Pass received CAN packet to TotemBUS for processing
         processCANPacket(id, data, len);
     }
+    void onServiceReceiveMessage(uint32_t id, uint8_t *data, uint16_t len) override {
+        processCANMessage(id, data, len);
+    }
 };
 
 } // namespace TotemLib
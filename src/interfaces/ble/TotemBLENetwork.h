@@ -20,13 +20,29 @@
 #define LIB_TOTEM_SRC_INTERFACES_BLE_TOTEMBLENETWORK
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/ringbuf.h"
 
+#include "lib/BufferArena.h"
 #include "lib/TotemNetwork.h"
 
+#ifndef TOTEMBLE_COALESCE_SLOTS
+#define TOTEMBLE_COALESCE_SLOTS 16 // Distinct commands waiting in queue with coalescing enabled
+#endif
+#ifndef TOTEMBLE_COALESCE_FRAMES
+#define TOTEMBLE_COALESCE_FRAMES 4 // Longer writes are queued without coalescing
+#endif
+#ifndef TOTEMBLE_EVENT_QUEUE_SIZE
+#define TOTEMBLE_EVENT_QUEUE_SIZE 4096 // Bytes of received events waiting for event task (power of 2)
+#endif
+
 namespace TotemLib {
 
 class TotemBLENetwork : public TotemNetwork {
-    TotemBUS::Memory<1, 256> memory;
+    // Transmit queue capacity in packets
+    static const int ControlQueuePackets = 32;
+    static const int BulkQueuePackets = 100;
+    TotemBUS::LeasedMemory<8> memory{BufferArena::shared().readerSource(256)};
     TotemBUS totemBUS;
     volatile struct {
         uint16_t number;
@@ -39,23 +55,93 @@ public:
     TotemBLENetwork() :
     totemBUS(memory, this, onTotemBUSCANSend, onTotemBUSMessageReceive)
     { 
-        sendPacketsQueue = xRingbufferCreate(sizeof(TotemBUSProtocol::CanPacket)*100, RINGBUF_TYPE_BYTEBUF);
+        totemBUS.setCANSendBatch(onTotemBUSCANSendBatch);
+        queuedCount = xSemaphoreCreateCounting(ControlQueuePackets+BulkQueuePackets, 0);
         FreeRTOS::startTask(canPacketsSendTask, "network_send", this, 3072);
     }
     ~TotemBLENetwork() {
         taskRunning = false;
+        setEventTask(false);
         moduleListMainReset();
-        vRingbufferDelete(sendPacketsQueue);
+        if (controlQueue) vRingbufferDelete(controlQueue);
+        if (bulkQueue) vRingbufferDelete(bulkQueue);
+        BufferArena::shared().release(controlStorage);
+        BufferArena::shared().release(bulkStorage);
+        vSemaphoreDelete(queuedCount);
+        delete eventQueue;
     }
 
     bool isConnected(uint16_t moduleNumber, uint16_t moduleSerial = 0) {
         return isModuleConnected(50, 2, moduleNumber, moduleSerial);
     }    
 
+    // Write replaces still queued write to the same module command.
+    // Only latest value is sent after link stall
+    void setCoalescing(bool enable) {
+        coalescing = enable;
+    }
+    // Messages dropped because deadline passed before sending
+    uint32_t getExpiredCount() {
+        return expiredCount;
+    }
+    // Module data receivers are called from own task instead of BLE receive
+    // context. Slow receiver does not stall responses of other modules.
+    // Events are dropped while queue is full
+    void setEventTask(bool enable, uint8_t priority = 1) {
+        if (!enable) {
+            if (eventTask == nullptr) return;
+            eventTaskRunning = false;
+            while (eventTask != nullptr) vTaskDelay(pdMS_TO_TICKS(10));
+            setEventQueue(nullptr);
+            return;
+        }
+        if (eventTask != nullptr) {
+            vTaskPrioritySet(eventTask, priority);
+            return;
+        }
+        if (eventQueue == nullptr) eventQueue = new StaticMessageQueue<TOTEMBLE_EVENT_QUEUE_SIZE>();
+        eventTaskRunning = true;
+        TaskHandle_t task;
+        if (xTaskCreate(eventsTask, "network_events", 4096, this, priority, &task) != pdPASS) return;
+        eventTask = task;
+        setEventQueue(eventQueue);
+    }
+    // Events not passed to receivers because event queue was full
+    uint32_t getDroppedEvents() {
+        return eventQueue ? eventQueue->getDropped() : 0;
+    }
+
+    using TotemNetwork::networkSend;
     bool networkSend(TotemBUS::Frame &frame, int number, int serial) override {
+        if (coalescing && frame.isRequest && !frame.data.isByte()) {
+            // Acknowledged write is answered once per send. It is never replaced
+            // and is not overtaken by newer write replacing one queued before it
+            if (!frame.data.isBit()) frame.coalesce = true;
+            else if (frame.data.isCommandInt()) sealCoalesced(number, serial, frame.data.getCommandInt());
+        }
         return frame.send(totemBUS, number, serial);
     }
 protected:
+    // Transmit queues are leased from shared arena when first connected.
+    // Each item is whole message, so packets of different messages never interleave.
+    // No-split item can take up to half of ring
+    bool openQueues() {
+        if (controlQueue != nullptr) return true;
+        BufferArena &arena = BufferArena::shared();
+        uint32_t controlSize, bulkSize;
+        controlStorage = arena.lease((sizeof(TotemBUSProtocol::CanPacket)*ControlQueuePackets+sizeof(QueueHeader))*2, controlSize);
+        bulkStorage = arena.lease((sizeof(TotemBUSProtocol::CanPacket)*BulkQueuePackets+sizeof(QueueHeader))*2, bulkSize);
+        if (controlStorage == nullptr || bulkStorage == nullptr) {
+            arena.release(controlStorage);
+            arena.release(bulkStorage);
+            controlStorage = bulkStorage = nullptr;
+            return false;
+        }
+        bulkQueue = xRingbufferCreateStatic(bulkSize, RINGBUF_TYPE_NOSPLIT, bulkStorage, &bulkRing);
+        // Packets are queued only after control queue is set
+        controlQueue = xRingbufferCreateStatic(controlSize, RINGBUF_TYPE_NOSPLIT, controlStorage, &controlRing);
+        return true;
+    }
     
     // Called from parent
     void processCANPacket(uint32_t id, uint8_t *data, uint8_t len) {
@@ -65,7 +151,17 @@ protected:
             //     log_e("TotemBUS Error: %d", result);
         }
     }
+    // Whole message received with native framing
+    void processCANMessage(uint32_t id, uint8_t *data, uint16_t len) {
+        if (TotemBUSProtocol::Packet::isV2(id)) {
+            totemBUS.processMessage(id, data, len);
+        }
+    }
     virtual void onCANPacketWrite(uint32_t id, uint8_t *data, uint8_t len) = 0;
+    // All queued messages are passed to onCANPacketWrite()
+    virtual void onCANPacketsFlush() {}
+    // Milliseconds until packets held by interface must be flushed. [-1] none held
+    virtual int32_t getFlushTimeout() { return -1; }
     // virtual void onModuleFound(uint16_t number, uint16_t serial) {}
 
     void onBUSMessageReceive(TotemBUS::Message &message) {
@@ -88,7 +184,34 @@ protected:
 
 private:
     volatile bool taskRunning = true;
-    RingbufHandle_t sendPacketsQueue;
+    MessageQueue *eventQueue = nullptr;
+    TaskHandle_t volatile eventTask = nullptr;
+    volatile bool eventTaskRunning = false;
+    RingbufHandle_t volatile controlQueue = nullptr;
+    RingbufHandle_t volatile bulkQueue = nullptr;
+    StaticRingbuffer_t controlRing;
+    StaticRingbuffer_t bulkRing;
+    uint8_t *controlStorage = nullptr;
+    uint8_t *bulkStorage = nullptr;
+    SemaphoreHandle_t queuedCount;
+    volatile uint32_t expiredCount = 0;
+    // Queue item. Message packets follow header, except for coalesced write
+    struct QueueHeader {
+        uint32_t expires; // [0] never
+        uint8_t slot;     // Coalesced write slot. [NoSlot] packets follow
+    };
+    static const uint8_t NoSlot = 0xFF;
+    // Latest packets of coalesced write. Queue holds slot index until sent
+    struct PendingWrite {
+        uint16_t number, serial;
+        uint32_t command;
+        uint32_t expires;
+        uint8_t count = 0; // [0] slot is free
+        bool sealed = false; // Not replaced by newer writes
+        TotemBUSProtocol::CanPacket packets[TOTEMBLE_COALESCE_FRAMES];
+    } pendingWrites[TOTEMBLE_COALESCE_SLOTS];
+    portMUX_TYPE pendingLock = portMUX_INITIALIZER_UNLOCKED;
+    bool coalescing = false;
 
     bool isModuleConnected(int timeout, int retries, uint16_t number, uint16_t serial, int32_t serialFilter = -1) {
         pingMonitor.number = number;
@@ -96,8 +219,8 @@ private:
         pingMonitor.detected = false;
         for (int ret=0; ret<retries; ret++) {
             TotemBUS::ping().send(totemBUS, number, serial);
-            uint32_t start = millis()+timeout;
-            while (start > millis()) {
+            uint32_t start = millis();
+            while ((int32_t)(millis() - start) < timeout) {
                 if (pingMonitor.detected) {
                     return true;
                 }
@@ -106,25 +229,152 @@ private:
         pingMonitor.detected = true;
         return false;
     }
+    static void eventsTask(void *context) {
+        TotemBLENetwork *network = static_cast<TotemBLENetwork*>(context);
+        while (network->eventTaskRunning) {
+            if (network->waitEvents(250)) network->pollEvents();
+        }
+        network->pollEvents();
+        network->eventTask = nullptr;
+        vTaskDelete(nullptr);
+    }
+    static bool isExpired(uint32_t expires) {
+        return expires != 0 && (int32_t)(millis() - expires) > 0;
+    }
     static void canPacketsSendTask(void *context) {
         TotemBLENetwork *network = static_cast<TotemBLENetwork*>(context);
-
-        TotemBUSProtocol::CanPacket *packet;
-        size_t packetSize;
         while (network->taskRunning) {
-            packet = (decltype(packet))xRingbufferReceiveUpTo(network->sendPacketsQueue, 
-            &packetSize, pdMS_TO_TICKS(250), sizeof(TotemBUSProtocol::CanPacket));
-
-            if (packet) {
-                network->onCANPacketWrite(packet->id, packet->data, packet->len);
-                vRingbufferReturnItem(network->sendPacketsQueue, packet);
+            // Wake to send coalesced packets when their flush delay passes
+            int32_t flushTimeout = network->getFlushTimeout();
+            TickType_t wait = pdMS_TO_TICKS(250);
+            if (flushTimeout >= 0 && pdMS_TO_TICKS(flushTimeout) < wait) wait = pdMS_TO_TICKS(flushTimeout);
+            if (xSemaphoreTake(network->queuedCount, wait) != pdTRUE) {
+                if (flushTimeout >= 0) network->onCANPacketsFlush();
+                continue;
             }
+            network->sendQueuedItem();
+            // Queue drained. Written packets can go out together
+            if (uxSemaphoreGetCount(network->queuedCount) == 0) network->onCANPacketsFlush();
         }
         FreeRTOS::deleteTask(nullptr);
     }
+    void sendQueuedItem() {
+        size_t itemSize;
+        // Serve control queue first. Bulk message is only preempted between messages
+        RingbufHandle_t queue = controlQueue;
+        QueueHeader *item = (QueueHeader*)xRingbufferReceive(queue, &itemSize, 0);
+        if (item == nullptr) {
+            queue = bulkQueue;
+            item = (QueueHeader*)xRingbufferReceive(queue, &itemSize, 0);
+        }
+        if (item == nullptr) return;
+        if (item->slot != NoSlot) {
+            // Coalesced write. Send latest packets stored in slot
+            PendingWrite pending;
+            PendingWrite &slot = pendingWrites[item->slot];
+            vRingbufferReturnItem(queue, item);
+            portENTER_CRITICAL(&pendingLock);
+            pending = slot;
+            slot.count = 0;
+            portEXIT_CRITICAL(&pendingLock);
+            if (isExpired(pending.expires)) {
+                expiredCount++;
+                return;
+            }
+            for (int i=0; i<pending.count; i++) {
+                onCANPacketWrite(pending.packets[i].id, pending.packets[i].data, pending.packets[i].len);
+            }
+            return;
+        }
+        // Expired message is dropped whole
+        if (isExpired(item->expires)) {
+            expiredCount++;
+            vRingbufferReturnItem(queue, item);
+            return;
+        }
+        TotemBUSProtocol::CanPacket *packets = (TotemBUSProtocol::CanPacket*)(item+1);
+        for (size_t i=0; i<(itemSize-sizeof(QueueHeader))/sizeof(TotemBUSProtocol::CanPacket); i++) {
+            onCANPacketWrite(packets[i].id, packets[i].data, packets[i].len);
+        }
+        vRingbufferReturnItem(queue, item);
+    }
+    static uint32_t getExpires(uint16_t deadline) {
+        if (deadline == 0) return 0;
+        uint32_t expires = millis() + deadline;
+        return expires ? expires : 1;
+    }
+    bool queueItem(QueueHeader header, TotemBUSProtocol::CanPacket *packets, size_t count, TotemBUS::Priority priority) {
+        if (controlQueue == nullptr) return false;
+        RingbufHandle_t queue = (priority == TotemBUS::Priority::Bulk) ? bulkQueue : controlQueue;
+        void *item = nullptr;
+        if (xRingbufferSendAcquire(queue, &item, sizeof(header)+sizeof(TotemBUSProtocol::CanPacket)*count, 0) != pdTRUE)
+            return false;
+        memcpy(item, &header, sizeof(header));
+        if (count) memcpy((QueueHeader*)item+1, packets, sizeof(TotemBUSProtocol::CanPacket)*count);
+        xRingbufferSendComplete(queue, item);
+        xSemaphoreGive(queuedCount);
+        return true;
+    }
+    bool queuePackets(TotemBUS::PacketBatch &batch) {
+        return queueItem({getExpires(batch.deadline), NoSlot}, batch.packets, batch.count, batch.priority);
+    }
+    // Replace pending write with same key or take free slot. Queue is bounded by slot count
+    bool queueCoalesced(TotemBUS::PacketBatch &batch) {
+        if (batch.count > TOTEMBLE_COALESCE_FRAMES) return queuePackets(batch);
+        int freeSlot = -1;
+        uint8_t index = 0;
+        uint32_t expires = getExpires(batch.deadline);
+        portENTER_CRITICAL(&pendingLock);
+        for (int i=0; i<TOTEMBLE_COALESCE_SLOTS; i++) {
+            PendingWrite &slot = pendingWrites[i];
+            if (slot.count == 0) {
+                if (freeSlot == -1) freeSlot = i;
+                continue;
+            }
+            if (!slot.sealed && slot.number == batch.number && slot.serial == batch.serial && slot.command == batch.command) {
+                memcpy(slot.packets, batch.packets, sizeof(TotemBUSProtocol::CanPacket)*batch.count);
+                slot.count = batch.count;
+                slot.expires = expires;
+                portEXIT_CRITICAL(&pendingLock);
+                return true;
+            }
+        }
+        if (freeSlot != -1) {
+            PendingWrite &slot = pendingWrites[freeSlot];
+            slot.number = batch.number;
+            slot.serial = batch.serial;
+            slot.command = batch.command;
+            slot.sealed = false;
+            memcpy(slot.packets, batch.packets, sizeof(TotemBUSProtocol::CanPacket)*batch.count);
+            slot.count = batch.count;
+            slot.expires = expires;
+            index = freeSlot;
+        }
+        portEXIT_CRITICAL(&pendingLock);
+        // All slots taken. Queue without coalescing
+        if (freeSlot == -1) return queuePackets(batch);
+        if (queueItem({0, index}, nullptr, 0, batch.priority)) return true;
+        portENTER_CRITICAL(&pendingLock);
+        pendingWrites[index].count = 0;
+        portEXIT_CRITICAL(&pendingLock);
+        return false;
+    }
+    // Pending write of command stays as queued. Newer writes take other slot
+    void sealCoalesced(uint16_t number, uint16_t serial, uint32_t command) {
+        portENTER_CRITICAL(&pendingLock);
+        for (auto &slot : pendingWrites) {
+            if (slot.count != 0 && slot.number == number && slot.serial == serial && slot.command == command) slot.sealed = true;
+        }
+        portEXIT_CRITICAL(&pendingLock);
+    }
     static bool onTotemBUSCANSend(void *context, TotemBUSProtocol::CanPacket &packet) {
-        return xRingbufferSendFromISR(static_cast<TotemBLENetwork*>(context)->sendPacketsQueue, 
-            &packet, sizeof(packet), nullptr) == pdTRUE;
+        return static_cast<TotemBLENetwork*>(context)->queueItem({0, NoSlot}, &packet, 1, TotemBUS::Priority::Control);
+    }
+    // Put all packets of message to queue with single operation
+    static bool onTotemBUSCANSendBatch(void *context, TotemBUS::PacketBatch &batch) {
+        TotemBLENetwork *network = static_cast<TotemBLENetwork*>(context);
+        if (batch.coalesce) return network->queueCoalesced(batch);
+        return network->queuePackets(batch);
     }
 	static bool onTotemBUSMessageReceive(void *context, TotemBUS::Message message) {
         static_cast<TotemBLENetwork*>(context)->onBUSMessageReceive(message);
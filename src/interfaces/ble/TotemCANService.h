@@ -27,6 +27,8 @@ class TotemCANServiceReceiver {
 public:
     virtual ~TotemCANServiceReceiver() {}
     virtual void onServiceReceive(uint32_t id, uint8_t *data, uint8_t len) = 0;
+    // Whole message: CAN ID of first packet and data of all packets
+    virtual void onServiceReceiveMessage(uint32_t id, uint8_t *data, uint16_t len) = 0;
 };
 
 class TotemCANService : protected TotemCANbus {
@@ -86,13 +88,47 @@ public:
         // txBuffer.limit(client->getMTU()-3);
         return true;
     }
-    void send(uint32_t id, uint8_t *data, uint8_t len, bool haltTransmission = false) {
-        if (!client->isConnected()) return;
-        writeCANPacket(id, data, len);
+    bool send(uint32_t id, uint8_t *data, uint8_t len, bool haltTransmission = false, uint32_t expires = 0) {
+        if (!client->isConnected()) return false;
+        return writeCANPacket(id, data, len, expires);
         // CanPacket packet(id, data, len);
         // appendTxBuffer(packet);
         // sendPendingData();
     }
+    // Packets dropped after deadline passed
+    uint32_t getExpiredCount() {
+        return TotemCANbus::getExpiredCount();
+    }
+    // Packets dropped because no TX buffer was free
+    uint32_t getDroppedCount() {
+        return TotemCANbus::getDroppedCount();
+    }
+    // Send multiple packets in single BLE write (up to MTU)
+    void setCoalescing(bool enable, uint16_t flushDelay = 5) {
+        setTxCoalescing(enable, flushDelay);
+    }
+    void cork() {
+        TotemCANbus::cork();
+    }
+    void uncork() {
+        TotemCANbus::uncork();
+    }
+    void flush() {
+        TotemCANbus::flush();
+    }
+    int32_t getFlushTimeout() {
+        return TotemCANbus::getFlushTimeout();
+    }
+    // Send whole message in single record (native framing). Enable only if peer supports it.
+    // Returns false if message does not fit single write
+    bool sendMessage(uint32_t id, const uint8_t *data, uint16_t len, uint32_t expires = 0) {
+        if (!client->isConnected()) return false;
+        return writeMessage(id, data, len, expires);
+    }
+    // Shorter packet headers. Enable only if peer supports it
+    void setPackedStreamV2(bool enable) {
+        TotemCANbus::setPackedStreamV2(enable);
+    }
 private:
     // Bluetooth received data
     static void onDataReceive(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
@@ -119,6 +155,9 @@ private:
     void onCANPacketReceive(uint32_t id, uint8_t *data, uint8_t len) override {
         receiver.onServiceReceive(id, data, len);
     }
+    void onCANMessageReceive(uint32_t id, uint8_t *data, uint16_t len) override {
+        receiver.onServiceReceiveMessage(id, data, len);
+    }
     // void processReceivedData(uint8_t *data, uint32_t len) {
     //     ByteBuffer stream(data, len);
     //     CanPacket packet;
@@ -21,32 +21,142 @@
 
 #include "CanPacket.h"
 #include "ByteBuffer.h"
+#include "lib/BufferArena.h"
 
 class TotemCANbus {
-    uint8_t _buffer[520];
+    // Leased from shared arena while it holds packets. Sized to getPacketLength()
+    uint8_t *txBlock = nullptr;
     ByteBuffer txBuffer;
+    // Latest deadline of buffered packets. Buffer is dropped only if all expired
+    uint32_t txExpires = 0;
+    bool txPersistent = false;
+    uint16_t txPackets = 0; // Packets or messages in buffer
+    uint32_t txExpiredCount = 0;
+    uint32_t txDroppedCount = 0;
+    // Coalescing: collect packets into single write up to getPacketLength()
+    bool txCoalescing = false;
+    uint8_t txCorked = 0; // Nested cork() depth
+    uint16_t txFlushDelay = 0;
+    uint32_t txQueuedTime = 0;
+    uint32_t txWriteCount = 0;
+    // Packed stream v2 (shorter packet headers). Supported by peer.
+    // Write of single packet is sent as v1: stream marker would cost more
+    bool txStreamV2 = false;
+    CanPacket::StreamState txStreamState;
+    // First packet of v2 buffer
+    uint32_t txFirstId = 0;
+    uint8_t txFirstData[8];
+    uint8_t txFirstLen = 0;
+    // Write contains packets in one of formats
+    enum class TxFormat : uint8_t {
+        Packets,
+        PacketsV2,
+        Messages,
+    } txFormat = TxFormat::Packets;
 
 protected:
     TotemCANbus() :
-    txBuffer(_buffer, sizeof(_buffer))
+    txBuffer(nullptr, 0)
     {}
+    virtual ~TotemCANbus() {
+        TotemLib::BufferArena::shared().release(txBlock);
+    }
     
     virtual int getPacketLength() = 0;
     virtual bool onWriteData(uint8_t *data, uint32_t len) = 0;
     virtual void onCANPacketReceive(uint32_t id, uint8_t *data, uint8_t len) = 0;
+    // Whole message received with native framing. See writeMessage()
+    virtual void onCANMessageReceive(uint32_t id, uint8_t *data, uint16_t len) {}
     
-    bool writeCANPacket(uint32_t id, uint8_t *data, uint8_t len) {
+    // Packet with expires (millis) is dropped if not sent until then. [0] never
+    bool writeCANPacket(uint32_t id, uint8_t *data, uint8_t len, uint32_t expires = 0) {
         CanPacket packet(id, data, len);
-        if (!appendTxBuffer(packet)) return false;
-        if (txBuffer.limit() != getPacketLength()) {
-            txBuffer.limit(getPacketLength());
+        // Packet sent at once is alone in write
+        TxFormat format = (txStreamV2 && (txCorked || txCoalescing)) ? TxFormat::PacketsV2 : TxFormat::Packets;
+        if (!prepareTxBuffer(format)) return dropped();
+        if (!appendPacket(packet)) {
+            // Buffer full. Send collected packets and retry
+            if (!restartTxBuffer(format) || !appendPacket(packet)) return dropped();
+        }
+        return queued(expires);
+    }
+    // Native framing. Write starts with MessageStream byte (standard packet length 14,
+    // never produced by v1). Each message: CAN ID of first packet (4 bytes), varint
+    // length and data of all message packets. Message must fit single write,
+    // otherwise returns false and should be sent as packets
+    static const uint8_t MessageStream = 0x76;
+    bool writeMessage(uint32_t id, const uint8_t *data, uint16_t len, uint32_t expires = 0) {
+        if (1 + getMessageSize(len) > getPacketLength()) return false;
+        if (!prepareTxBuffer(TxFormat::Messages)) return false;
+        if (!appendMessage(id, data, len)) {
+            if (!restartTxBuffer(TxFormat::Messages) || !appendMessage(id, data, len)) return false;
         }
+        return queued(expires);
+    }
+    // Pack multiple packets into single write. Collected packets are sent when buffer
+    // is full, on flush() or by write arriving after flushDelay (ms) since first packet.
+    // Owner calls flush() when getFlushTimeout() passes, so packets are held at most flushDelay
+    void setTxCoalescing(bool enable, uint16_t flushDelay) {
+        txCoalescing = enable;
+        txFlushDelay = flushDelay;
+        if (!enable) flush();
+    }
+    // Hold all packets until uncork(). Used to send message in single write.
+    // Nests: packets are sent when outermost cork is removed
+    void cork() {
+        txCorked++;
+    }
+    void uncork() {
+        if (txCorked == 0 || --txCorked != 0) return;
         sendPendingData();
-        return true;
+    }
+    void flush() {
+        if (!txCorked) sendPendingData();
+    }
+    // Milliseconds until held packets must be sent with flush(). [-1] nothing held
+    int32_t getFlushTimeout() {
+        if (txPackets == 0 || txCorked) return -1;
+        int32_t left = (int32_t)txFlushDelay - (int32_t)(millis() - txQueuedTime);
+        return (left > 0) ? left : 0;
+    }
+    // Number of writes passed to onWriteData()
+    uint32_t getWriteCount() {
+        return txWriteCount;
+    }
+    // Send with packed stream v2. Enable only if peer supports it. Receive accepts both
+    void setPackedStreamV2(bool enable) {
+        txStreamV2 = enable;
     }
     void processReceivedData(const uint8_t *data, uint32_t len) {
         ByteBuffer stream(const_cast<uint8_t*>(data), len);
         CanPacket packet;
+        if (len > 0 && data[0] == MessageStream) {
+            uint32_t index = 1;
+            while (index + 5 <= len) {
+                uint32_t id = (uint32_t)data[index] << 24 | (uint32_t)data[index+1] << 16
+                    | (uint32_t)data[index+2] << 8 | data[index+3];
+                index += 4;
+                uint32_t size = 0;
+                for (int shift = 0; ; shift += 7) {
+                    if (shift > 14 || index >= len) return;
+                    uint8_t byte = data[index++];
+                    size |= (uint32_t)(byte & 0x7F) << shift;
+                    if ((byte & 0x80) == 0) break;
+                }
+                if (size > len - index) return;
+                onCANMessageReceive(id, const_cast<uint8_t*>(data) + index, size);
+                index += size;
+            }
+            return;
+        }
+        if (len > 0 && data[0] == CanPacket::StreamV2) {
+            CanPacket::StreamState state;
+            stream.get();
+            while (CanPacket::fromPackedStream(stream, packet, state)) {
+                onCANPacketReceive(packet.id(), packet.data(), packet.len());
+            }
+            return;
+        }
         while (CanPacket::fromPackedStream(stream, packet)) {
             onCANPacketReceive(packet.id(), packet.data(), packet.len());
         }
@@ -54,22 +164,118 @@ protected:
     void onPacketsAvailable() {
         sendPendingData();
     }
+    uint32_t getExpiredCount() {
+        return txExpiredCount;
+    }
+    // Packets not sent because no TX buffer was free in BufferArena
+    uint32_t getDroppedCount() {
+        return txDroppedCount;
+    }
 
 private:
-    bool appendTxBuffer(CanPacket &packet) { 
+    static const int MaxPackedSize = 13;
+    bool startTxBuffer(TxFormat format) {
+        if (txBlock == nullptr) {
+            uint32_t capacity;
+            txBlock = TotemLib::BufferArena::shared().lease(getPacketLength(), capacity);
+            if (txBlock == nullptr) return false;
+            txBuffer = ByteBuffer(txBlock, capacity);
+        }
+        txBuffer.clear();
+        txBuffer.limit(getPacketLength());
+        txQueuedTime = millis();
+        txFormat = format;
+        if (format == TxFormat::PacketsV2) {
+            txStreamState = CanPacket::StreamState();
+            txBuffer.put(CanPacket::StreamV2);
+        }
+        else if (format == TxFormat::Messages) {
+            txBuffer.put(MessageStream);
+        }
+        return true;
+    }
+    // Buffer of other format is sent before starting new one
+    bool prepareTxBuffer(TxFormat format) {
+        if (txPackets != 0 && txFormat != format) sendPendingData();
+        if (txPackets == 0 && !startTxBuffer(format)) return false;
+        return txFormat == format;
+    }
+    bool dropped() {
+        if (txBlock == nullptr) txDroppedCount++;
+        return false;
+    }
+    bool restartTxBuffer(TxFormat format) {
+        if (txPackets == 0) return false;
+        sendPendingData();
+        if (txPackets != 0) return false;
+        return startTxBuffer(format);
+    }
+    bool queued(uint32_t expires) {
+        txPackets++;
+        if (expires == 0) txPersistent = true;
+        else if (txExpires == 0 || (int32_t)(expires - txExpires) > 0) txExpires = expires;
+        if (txCorked) return true;
+        // Hold until buffer fills, flush() or flush delay passes
+        if (txCoalescing && txBuffer.remaining() >= MaxPackedSize
+        && (uint32_t)(millis() - txQueuedTime) < txFlushDelay) return true;
+        sendPendingData();
+        return true;
+    }
+    static uint16_t getMessageSize(uint16_t len) {
+        return 4 + (len < 0x80 ? 1 : (len < 0x4000 ? 2 : 3)) + len;
+    }
+    bool appendMessage(uint32_t id, const uint8_t *data, uint16_t len) {
+        if (txBuffer.remaining() < getMessageSize(len)) return false;
+        txBuffer.putInt(id);
+        uint32_t size = len;
+        do {
+            uint8_t byte = size & 0x7F;
+            size >>= 7;
+            txBuffer.put(byte | (size ? 0x80 : 0));
+        } while (size);
+        txBuffer.put(const_cast<uint8_t*>(data), len);
+        return true;
+    }
+    bool appendPacket(CanPacket &packet) { 
         if (!txBuffer.hasRemaining()) return false;
-        CanPacket::Data<13> packetArray;
-        if (!packet.arrayPacked(packetArray)) return false;
+        CanPacket::Data<MaxPackedSize> packetArray;
+        // Stream state is kept only if packet fits
+        CanPacket::StreamState state = txStreamState;
+        if (!(txFormat == TxFormat::PacketsV2 ? packet.arrayPacked(packetArray, state) : packet.arrayPacked(packetArray))) return false;
         if (txBuffer.remaining() < packetArray.length) {
            txBuffer.limit(txBuffer.position());
             return false;
         }
         txBuffer.put(packetArray.data, packetArray.length);
+        txStreamState = state;
+        if (txPackets == 0) {
+            txFirstId = packet.id();
+            txFirstLen = packet.len();
+            memcpy(txFirstData, packet.data(), txFirstLen);
+        }
         return true;
     }
     
+    // Single packet of v2 buffer is rewritten in v1
+    void repackFirst() {
+        CanPacket packet(txFirstId, txFirstData, txFirstLen);
+        CanPacket::Data<MaxPackedSize> packetArray;
+        if (!packet.arrayPacked(packetArray)) return;
+        txBuffer.clear();
+        txBuffer.limit(getPacketLength());
+        txBuffer.put(packetArray.data, packetArray.length);
+        txFormat = TxFormat::Packets;
+    }
+    void clearTxBuffer() {
+        TotemLib::BufferArena::shared().release(txBlock);
+        txBlock = nullptr;
+        txBuffer = ByteBuffer(nullptr, 0);
+        txExpires = 0;
+        txPersistent = false;
+        txPackets = 0;
+    }
     void sendPendingData() { 
-        while (/*!txQueue.isEmpty() || */txBuffer.position() != 0) {
+        while (/*!txQueue.isEmpty() || */txPackets != 0) {
             /*if (txBuffer.hasRemaining()) {
                 CanPacket packet;
                 while ((packet = txQueue.peek()) != null) {
@@ -77,10 +283,18 @@ private:
                     txQueue.poll();
                 }
             }*/
-            if (/*ble.isPacketsPending() || */txBuffer.position() == 0) return;
+            if (/*ble.isPacketsPending() || */txPackets == 0) return;
+            // Drop stale packets instead of sending
+            if (!txPersistent && (int32_t)(millis() - txExpires) > 0) {
+                txExpiredCount += txPackets;
+                clearTxBuffer();
+                return;
+            }
+            if (txFormat == TxFormat::PacketsV2 && txPackets == 1) repackFirst();
             if (!onWriteData(txBuffer.array(), txBuffer.position())) return;
+            txWriteCount++;
             // Clear TX buffer on success
-            txBuffer.clear();
+            clearTxBuffer();
         }
         
         // if (txBuffer.limit() != getPacketLength())
@@ -0,0 +1,70 @@
+/* 
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef LIB_TOTEM_SRC_INTERFACES_LOOPBACK_LOOPBACKTRANSPORT
+#define LIB_TOTEM_SRC_INTERFACES_LOOPBACK_LOOPBACKTRANSPORT
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "lib/TotemTransport.h"
+
+namespace TotemLib {
+
+// In-process transport. Packets sent by endpoint are received by its peer on poll.
+// Send and poll can be called from different threads
+class LoopbackTransport : public TotemTransport {
+    std::mutex lock;
+    std::condition_variable signal;
+    std::vector<TotemBUSProtocol::CanPacket> queue;
+    std::vector<TotemBUSProtocol::CanPacket> processing;
+    LoopbackTransport *peer = nullptr;
+public:
+    LoopbackTransport() { }
+    LoopbackTransport(LoopbackTransport &peer) {
+        connect(*this, peer);
+    }
+    ~LoopbackTransport() {
+        if (peer) peer->peer = nullptr;
+    }
+    static void connect(LoopbackTransport &first, LoopbackTransport &second) {
+        first.peer = &second;
+        second.peer = &first;
+    }
+
+    bool transportSend(TotemBUSProtocol::CanPacket *packets, size_t count) override {
+        if (peer == nullptr) return false;
+        {
+            std::lock_guard<std::mutex> guard(peer->lock);
+            peer->queue.insert(peer->queue.end(), packets, packets + count);
+        }
+        peer->signal.notify_one();
+        return true;
+    }
+    int transportPoll(int timeout) override {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (queue.empty() && timeout > 0) {
+                signal.wait_for(guard, std::chrono::milliseconds(timeout), [this]() { return !queue.empty(); });
+            }
+            processing.swap(queue);
+        }
+        // Deliver outside lock. Receiver may send response to peer
+        for (auto &packet : processing) {
+            transportReceive(packet.id, packet.data, packet.len);
+        }
+        int count = processing.size();
+        processing.clear();
+        return count;
+    }
+};
+
+} // namespace TotemLib
+
+#endif /* LIB_TOTEM_SRC_INTERFACES_LOOPBACK_LOOPBACKTRANSPORT */
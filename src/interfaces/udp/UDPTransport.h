@@ -0,0 +1,207 @@
+/* 
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef LIB_TOTEM_SRC_INTERFACES_UDP_UDPTRANSPORT
+#define LIB_TOTEM_SRC_INTERFACES_UDP_UDPTRANSPORT
+
+#ifndef __linux__
+#error "UDPTransport.h is only supported on Linux"
+#endif
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <mutex>
+
+#include "lib/TotemTransport.h"
+#include "interfaces/ble/CanPacket.h"
+
+namespace TotemLib {
+
+// Transport over UDP socket. Packets are packed into datagrams in the same
+// format as BLE CAN service. Datagrams are sent with single sendmmsg() call
+// per message and received in bulk with recvmmsg(). Packets of a message
+// are never split between datagrams.
+// With auto flush disabled, messages are collected until flush().
+// Send and poll can be called from different threads
+class UDPTransport : public TotemTransport {
+public:
+    static const int DatagramSize = 1400;
+    static const int BatchCount = 16;
+
+    ~UDPTransport() {
+        end();
+    }
+    // Bind to local port. If remote address is not set, packets are sent to
+    // last datagram sender
+    bool begin(uint16_t localPort, const char *remoteAddress = nullptr, uint16_t remotePort = 0) {
+        end();
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) return false;
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(localPort);
+        if (bind(fd, (sockaddr*)&local, sizeof(local)) != 0) {
+            end();
+            return false;
+        }
+        sockaddr_in address = {};
+        if (remoteAddress) {
+            address.sin_family = AF_INET;
+            address.sin_port = htons(remotePort);
+            if (inet_pton(AF_INET, remoteAddress, &address.sin_addr) != 1) {
+                end();
+                return false;
+            }
+        }
+        std::lock_guard<std::mutex> lock(remoteMutex);
+        remote = address;
+        remoteSet = remoteAddress != nullptr;
+        remoteFixed = remoteSet;
+        return true;
+    }
+    void end() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    // Bound port. Useful when started with port 0
+    uint16_t getLocalPort() {
+        sockaddr_in local = {};
+        socklen_t length = sizeof(local);
+        if (fd < 0 || getsockname(fd, (sockaddr*)&local, &length) != 0) return 0;
+        return ntohs(local.sin_port);
+    }
+
+    void setAutoFlush(bool enable) {
+        autoFlush = enable;
+    }
+    // Send collected datagrams
+    bool flush() {
+        int count = txCount + (txLength[txCount] > 0 ? 1 : 0);
+        if (count == 0) return true;
+        txCount = 0;
+        if (fd < 0 || !getRemote(txAddress)) {
+            txLength[0] = 0;
+            return false;
+        }
+        for (int i=0; i<count; i++) {
+            txVector[i].iov_base = txBuffer[i];
+            txVector[i].iov_len = txLength[i];
+            txMessage[i].msg_hdr = {};
+            txMessage[i].msg_hdr.msg_iov = &txVector[i];
+            txMessage[i].msg_hdr.msg_iovlen = 1;
+            txMessage[i].msg_hdr.msg_name = &txAddress;
+            txMessage[i].msg_hdr.msg_namelen = sizeof(txAddress);
+        }
+        txLength[0] = 0;
+        int sent = 0;
+        while (sent < count) {
+            int result = sendmmsg(fd, &txMessage[sent], count - sent, 0);
+            if (result <= 0) return false;
+            sent += result;
+        }
+        return true;
+    }
+
+    // Message is packed whole before it is added to datagram, so a lost or
+    // failed datagram drops whole messages only. Fails if message does not fit
+    // single datagram
+    bool transportSend(TotemBUSProtocol::CanPacket *packets, size_t count) override {
+        if (fd < 0 || !isRemoteSet()) return false;
+        uint8_t message[DatagramSize];
+        uint16_t length = 0;
+        for (size_t i=0; i<count; i++) {
+            ::CanPacket packet(packets[i].id, packets[i].data, packets[i].len);
+            ::CanPacket::Data<13> packed;
+            if (!packet.arrayPacked(packed)) return false;
+            if (length + packed.length > DatagramSize) return false;
+            memcpy(&message[length], packed.data, packed.length);
+            length += packed.length;
+        }
+        if (txLength[txCount] + length > DatagramSize) {
+            if (txCount + 1 == BatchCount) {
+                if (!flush()) return false;
+            }
+            else {
+                txLength[++txCount] = 0;
+            }
+        }
+        memcpy(&txBuffer[txCount][txLength[txCount]], message, length);
+        txLength[txCount] += length;
+        return autoFlush ? flush() : true;
+    }
+    int transportPoll(int timeout) override {
+        if (fd < 0) return 0;
+        if (timeout > 0) {
+            pollfd descriptor = {fd, POLLIN, 0};
+            if (poll(&descriptor, 1, timeout) <= 0) return 0;
+        }
+        int total = 0;
+        int received;
+        do {
+            for (int i=0; i<BatchCount; i++) {
+                rxVector[i].iov_base = rxBuffer[i];
+                rxVector[i].iov_len = DatagramSize;
+                rxMessage[i].msg_hdr = {};
+                rxMessage[i].msg_hdr.msg_iov = &rxVector[i];
+                rxMessage[i].msg_hdr.msg_iovlen = 1;
+                rxMessage[i].msg_hdr.msg_name = &rxAddress[i];
+                rxMessage[i].msg_hdr.msg_namelen = sizeof(rxAddress[i]);
+            }
+            received = recvmmsg(fd, rxMessage, BatchCount, MSG_DONTWAIT, nullptr);
+            if (received > 0 && !remoteFixed) {
+                std::lock_guard<std::mutex> lock(remoteMutex);
+                remote = rxAddress[received-1];
+                remoteSet = true;
+            }
+            for (int i=0; i<received; i++) {
+                ByteBuffer stream(rxBuffer[i], rxMessage[i].msg_len);
+                ::CanPacket packet;
+                while (::CanPacket::fromPackedStream(stream, packet)) {
+                    transportReceive(packet.id(), packet.data(), packet.len());
+                    total++;
+                }
+            }
+        } while (received == BatchCount);
+        return total;
+    }
+private:
+    int fd = -1;
+    // Written by poll of other thread if not fixed by begin()
+    std::mutex remoteMutex;
+    sockaddr_in remote = {};
+    bool remoteSet = false;
+    bool remoteFixed = false;
+    sockaddr_in txAddress = {};
+    bool autoFlush = true;
+    int txCount = 0;
+    uint8_t txBuffer[BatchCount][DatagramSize];
+    uint16_t txLength[BatchCount] = {};
+    mmsghdr txMessage[BatchCount];
+    iovec txVector[BatchCount];
+    uint8_t rxBuffer[BatchCount][DatagramSize];
+    mmsghdr rxMessage[BatchCount];
+    iovec rxVector[BatchCount];
+    sockaddr_in rxAddress[BatchCount];
+
+    bool isRemoteSet() {
+        std::lock_guard<std::mutex> lock(remoteMutex);
+        return remoteSet;
+    }
+    bool getRemote(sockaddr_in &address) {
+        std::lock_guard<std::mutex> lock(remoteMutex);
+        address = remote;
+        return remoteSet;
+    }
+};
+
+} // namespace TotemLib
+
+#endif /* LIB_TOTEM_SRC_INTERFACES_UDP_UDPTRANSPORT */
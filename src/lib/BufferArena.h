@@ -0,0 +1,189 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef LIB_TOTEM_SRC_LIB_BUFFERARENA
+#define LIB_TOTEM_SRC_LIB_BUFFERARENA
+
+#include <atomic>
+#include <initializer_list>
+#include <new>
+#include <stdint.h>
+
+#include "core/TotemBUSProtocol.h"
+
+// BLE connections open at once. Arena block counts scale with it
+#ifndef TOTEM_MAX_CONNECTIONS
+#if defined(CONFIG_BT_ACL_CONNECTIONS)
+#define TOTEM_MAX_CONNECTIONS CONFIG_BT_ACL_CONNECTIONS
+#else
+#define TOTEM_MAX_CONNECTIONS 4
+#endif
+#endif
+// Block sizes (ascending). Defaults fit module and network Readers,
+// TX buffer of 517 MTU, control and bulk transmit rings
+#ifndef TOTEM_ARENA_SIZES
+#define TOTEM_ARENA_SIZES { 128, 256, 520, 1040, 3216 }
+#endif
+// Blocks of each size a single connection can lease at once
+#ifndef TOTEM_ARENA_CONNECTION_BLOCKS
+#define TOTEM_ARENA_CONNECTION_BLOCKS { 2, 8, 1, 1, 1 }
+#endif
+
+namespace TotemLib {
+
+// Buffers shared by all connections. Taken only while connection or message
+// needs them. Lease is served by the smallest free block that fits.
+// Block memory is allocated when block is leased first time and reused after
+class BufferArena {
+public:
+    static const int MaxClasses = 8;
+    static const int MaxBlocks = 128; // Per class
+    struct Stats {
+        uint32_t size;      // Block size
+        uint32_t blocks;    // Blocks in class
+        uint32_t used;      // Blocks leased now
+        uint32_t highWater; // Most blocks leased at once
+    };
+    // Class i has blocks[i] * connections blocks of sizes[i] bytes
+    BufferArena(std::initializer_list<uint16_t> sizes, std::initializer_list<uint8_t> blocks, uint32_t connections = 1) {
+        for (uint16_t size : sizes) {
+            if (classes == MaxClasses) break;
+            uint32_t count = (classes < (int)blocks.size()) ? blocks.begin()[classes] * connections : 0;
+            block[classes].size = (size + 7) & ~7;
+            block[classes].count = (count > MaxBlocks) ? MaxBlocks : count;
+            classes++;
+        }
+    }
+    ~BufferArena() {
+        for (int i=0; i<classes; i++) {
+            for (uint32_t b=0; b<block[i].count; b++) delete[] block[i].memory[b].load();
+        }
+    }
+    // Shared arena of TOTEM_ARENA_SIZES and TOTEM_ARENA_CONNECTION_BLOCKS for
+    // TOTEM_MAX_CONNECTIONS. Holds no memory until first lease
+    static BufferArena &shared() {
+        static BufferArena arena(TOTEM_ARENA_SIZES, TOTEM_ARENA_CONNECTION_BLOCKS, TOTEM_MAX_CONNECTIONS);
+        return arena;
+    }
+    // Lease buffer of at least size bytes. capacity is set to block size.
+    // Returns nullptr if all fitting blocks are taken or out of heap
+    uint8_t *lease(uint32_t size, uint32_t &capacity) {
+        for (int i=0; i<classes; i++) {
+            Class &item = block[i];
+            if (item.size < size) continue;
+            int index = item.claim();
+            if (index < 0) continue;
+            uint64_t *memory = item.memory[index].load(std::memory_order_relaxed);
+            if (memory == nullptr) {
+                // Header word: class and block index for release()
+                memory = new (std::nothrow) uint64_t[1 + item.size/8];
+                if (memory == nullptr) {
+                    item.unclaim(index);
+                    break;
+                }
+                memory[0] = (uint64_t)i << 16 | index;
+                item.memory[index].store(memory, std::memory_order_relaxed);
+                allocated.fetch_add(item.size, std::memory_order_relaxed);
+            }
+            capacity = item.size;
+            return reinterpret_cast<uint8_t*>(memory + 1);
+        }
+        failed.fetch_add(1, std::memory_order_relaxed);
+        capacity = 0;
+        return nullptr;
+    }
+    uint8_t *lease(uint32_t size) {
+        uint32_t capacity;
+        return lease(size, capacity);
+    }
+    // Return leased buffer. nullptr is ignored
+    void release(uint8_t *buffer) {
+        if (buffer == nullptr) return;
+        uint64_t header = reinterpret_cast<uint64_t*>(buffer)[-1];
+        block[header >> 16].unclaim(header & 0xFFFF);
+    }
+    int getClassCount() {
+        return classes;
+    }
+    Stats getStats(int index) {
+        Class &item = block[index];
+        return {item.size, item.count, item.getUsed(), item.highWater.load()};
+    }
+    // Bytes of blocks allocated so far
+    uint32_t getSize() {
+        return allocated;
+    }
+    // Bytes of blocks needed to serve most leases of each class seen
+    uint32_t getHighWater() {
+        uint32_t bytes = 0;
+        for (int i=0; i<classes; i++) bytes += (uint32_t)block[i].size * block[i].highWater;
+        return bytes;
+    }
+    // Leases not served because fitting blocks were taken
+    uint32_t getFailedCount() {
+        return failed;
+    }
+    // TotemBUS Readers lease buffer of size while receiving message
+    TotemBUSProtocol::BufferSource readerSource(uint16_t size) {
+        return {this, size, onReaderLease, onReaderRelease};
+    }
+private:
+    static const int Words = MaxBlocks / 32;
+    struct Class {
+        uint16_t size = 0;
+        uint32_t count = 0;
+        std::atomic<uint32_t> usedMask[Words] = {};
+        std::atomic<uint32_t> highWater{0};
+        std::atomic<uint64_t*> memory[MaxBlocks] = {};
+        // Take free block. [-1] none
+        int claim() {
+            for (uint32_t w=0; w*32<count; w++) {
+                uint32_t valid = (count - w*32 >= 32) ? ~0UL : (1UL << (count - w*32)) - 1;
+                uint32_t free = ~usedMask[w].load(std::memory_order_relaxed) & valid;
+                while (free) {
+                    uint32_t bit = 1UL << __builtin_ctz(free);
+                    uint32_t mask = usedMask[w].fetch_or(bit, std::memory_order_acquire);
+                    if ((mask & bit) == 0) {
+                        updateMax(highWater, getUsed());
+                        return w*32 + __builtin_ctz(bit);
+                    }
+                    free = ~mask & valid;
+                }
+            }
+            return -1;
+        }
+        void unclaim(uint32_t index) {
+            usedMask[index / 32].fetch_and(~(1UL << (index % 32)), std::memory_order_release);
+        }
+        uint32_t getUsed() {
+            uint32_t used = 0;
+            for (int w=0; w<Words; w++) used += __builtin_popcount(usedMask[w].load(std::memory_order_relaxed));
+            return used;
+        }
+    } block[MaxClasses];
+    int classes = 0;
+    std::atomic<uint32_t> allocated{0};
+    std::atomic<uint32_t> failed{0};
+
+    static void updateMax(std::atomic<uint32_t> &max, uint32_t value) {
+        uint32_t current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+    static uint8_t *onReaderLease(void *context, uint16_t &size) {
+        uint32_t capacity;
+        uint8_t *buffer = static_cast<BufferArena*>(context)->lease(size, capacity);
+        size = (capacity > 0xFFFF) ? 0xFFFF : capacity;
+        return buffer;
+    }
+    static void onReaderRelease(void *context, uint8_t *buffer) {
+        static_cast<BufferArena*>(context)->release(buffer);
+    }
+};
+
+} // namespace TotemLib
+
+#endif /* LIB_TOTEM_SRC_LIB_BUFFERARENA */
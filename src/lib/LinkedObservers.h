@@ -19,13 +19,27 @@
 #ifndef LIB_TOTEM_SRC_COMMON_LINKEDOBSERVERS
 #define LIB_TOTEM_SRC_COMMON_LINKEDOBSERVERS
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
 class Observer;
 
 /**
  * Linked list objects manager.
- * Each object (Observer) that is added to the list itself has "next" pointer
- * that this class will access. All Objects list are linked trough their internal
- * "next" pointer. This gives unlimited size of list that is initialised statically.
+ * Each object (Observer) that is added to the list itself has "next" and "prev"
+ * pointers that this class will access. All Objects list are linked trough their
+ * internal pointers. This gives unlimited size of list that is initialised statically.
+ * Add and remove are O(1).
+ *
+ * Iteration (for_each, find, read) is lock-free and may run while other tasks
+ * add or remove observers. Removed observer keeps its "next" pointer, so iteration
+ * standing on it continues. remove() returns only after all iterations started
+ * before removal have finished, then observer can be reused or destroyed.
+ * Removal from inside iteration of the same list (e.g. callback destroys observer)
+ * does not wait: iterations of calling task skip removed observer, iterations of
+ * other tasks may still visit it until next synchronize() outside iteration.
  *
  * Template argument:
  * The type of base class that will be added to list and contains "next" pointer.
@@ -57,115 +71,215 @@ class Observer;
  */
 template <class Type = Observer>
 class LinkedObservers {
-	Type *first = nullptr;
+	std::atomic<Type*> first;
+	Type *tail = nullptr;
+	// Serializes add, remove and move
+	std::mutex writeLock;
+	// Running iterations are counted in one of two counters selected by
+	// epoch. synchronize() flips epoch and waits for old counter to drain
+	std::atomic<uint32_t> epoch;
+	std::atomic<uint32_t> readers[2];
+	std::mutex syncLock;
+	// Read sections of calling task, innermost first. for_each keeps next
+	// observer in cursor, removal inside callback moves it
+	struct Section {
+		LinkedObservers *list;
+		Type *cursor;
+		Section *outer;
+	};
+	static Section *&getSections() {
+		static thread_local Section *sections = nullptr;
+		return sections;
+	}
 public:
+	LinkedObservers() {
+		first = nullptr;
+		epoch = 0;
+		readers[0] = 0;
+		readers[1] = 0;
+	}
 	// Add all observers from provided list
-	// Given list will be empty after append.
+	// Given list will be empty after append. Moved observers may still be
+	// iterated by given list until list.synchronize()
 	void moveFrom(LinkedObservers<Type> &list) {
-		Type *lastObj = last();
-		if (lastObj == nullptr)
-			first = list.first;
+		std::lock_guard<std::mutex> lock(writeLock);
+		Type *moved, *movedTail;
+		{
+			std::lock_guard<std::mutex> listLock(list.writeLock);
+			moved = list.first.load();
+			movedTail = list.tail;
+			list.first = nullptr;
+			list.tail = nullptr;
+		}
+		if (moved == nullptr) return;
+		for (Type *object = moved; object != nullptr; object = static_cast<Type*>(object->next.load()))
+			object->owner = this;
+		moved->prev = tail;
+		if (tail == nullptr)
+			first.store(moved, std::memory_order_release);
 		else
-			lastObj->next = list.first;
-		// Clear old list. All elements has moved
-		list.clear();
+			tail->next.store(moved, std::memory_order_release);
+		tail = movedTail;
 	}
 	// Add observer to linked list
 	// true  - success
 	// false - already added
 	bool add(Type &observer) {
-		observer.next = nullptr;
-		Type *object = first;
-		if (object == nullptr) {
-			first = &observer;
-			return true;
-		}
-		if (object == &observer) return false;
-		while (object->next != nullptr) {
-			if (object == &observer) 
-				return false;
-			object = static_cast<Type*>(object->next);
-		}
-		object->next = &observer;
+		std::lock_guard<std::mutex> lock(writeLock);
+		if (observer.owner == this) return false;
+		observer.owner = this;
+		observer.prev = tail;
+		observer.next.store(nullptr, std::memory_order_relaxed);
+		// Publish initialised observer
+		if (tail == nullptr)
+			first.store(&observer, std::memory_order_release);
+		else
+			tail->next.store(&observer, std::memory_order_release);
+		tail = &observer;
 		return true;
 	}
 	// Remove observer from linked list
 	// true  - removed
 	// false - not found
 	bool remove(Type &observer) {
-		if (first == &observer) {
-			first = static_cast<Type*>(observer.next);
-			observer.next = nullptr;
-			return true;
+		if (!unlink(observer)) return false;
+		synchronize();
+		return true;
+	}
+	// Remove observer without waiting for running iterations. Observer can be
+	// reused or destroyed after synchronize()
+	bool unlink(Type &observer) {
+		std::lock_guard<std::mutex> lock(writeLock);
+		if (observer.owner != this) return false;
+		Type *next = static_cast<Type*>(observer.next.load(std::memory_order_relaxed));
+		if (observer.prev == nullptr)
+			first.store(next, std::memory_order_release);
+		else
+			observer.prev->next.store(next, std::memory_order_release);
+		if (next == nullptr)
+			tail = static_cast<Type*>(observer.prev);
+		else
+			next->prev = observer.prev;
+		observer.prev = nullptr;
+		observer.owner = nullptr;
+		for (Section *section = getSections(); section != nullptr; section = section->outer) {
+			if (section->list == this && section->cursor == &observer) section->cursor = next;
 		}
-		Type *object = first;
-		while (object != nullptr) {
-			if (object->next == &observer) {
-				Type *rmObject = object->next;
-				object->next = rmObject->next;
-				rmObject->next = nullptr;
-				return true;
+		return true;
+	}
+	// Remove all observes from list
+	void clear() {
+		{
+			std::lock_guard<std::mutex> lock(writeLock);
+			for (Type *object = first.load(); object != nullptr; object = static_cast<Type*>(object->next.load()))
+				object->owner = nullptr;
+			first = nullptr;
+			tail = nullptr;
+		}
+		synchronize();
+	}
+	// Wait until iterations started before this call are finished.
+	// Returns false without waiting if called inside iteration of this list
+	bool synchronize() {
+		if (isReading()) return false;
+		std::lock_guard<std::mutex> lock(syncLock);
+		// Flip twice: iteration may have read epoch before previous flip
+		for (int i=0; i<2; i++) {
+			uint32_t old = epoch.fetch_add(1) & 1;
+			while (readers[old].load() != 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
 			}
-			object = static_cast<Type*>(object->next);
+		}
+		return true;
+	}
+	// Calling task is inside iteration of this list
+	bool isReading() {
+		for (Section *section = getSections(); section != nullptr; section = section->outer) {
+			if (section->list == this) return true;
 		}
 		return false;
 	}
-	// Remove all observes from list
-	void clear() {
-		first = nullptr;
+	// Run function inside iteration section. Observers stay valid until it returns
+	template <typename Function>
+	void read(Function func) {
+		Section section;
+		uint32_t index = readLock(section);
+		func();
+		readUnlock(index, section);
 	}
 	bool isEmpty() {
-		return first == nullptr;
+		return first.load() == nullptr;
 	}
 	int count() {
 		int cnt = 0;
-		Type *object = first;
-		while (object != nullptr) {
-			object = static_cast<Type*>(object->next);
-			cnt++;
-		}
+		for_each([&](Type *object) { cnt++; });
 		return cnt;
 	}
+	// Unguarded iteration. Use for_each() if list is modified by other tasks
 	Type* begin() {
-		return first;
+		return first.load(std::memory_order_acquire);
 	}
 	Type* next(Type* it) {
-		return it->next;
+		return static_cast<Type*>(it->next.load(std::memory_order_acquire));
 	}
 	Type* end() {
 		return nullptr;
 	}
 	Type* last() {
-		Type *object = first;
-		if (object == nullptr) return nullptr;
-		while (object->next != nullptr) {
-			object = static_cast<Type*>(object->next);
-		}
-		return object;
+		std::lock_guard<std::mutex> lock(writeLock);
+		return tail;
 	}
 	template <typename CastType = Type, typename Function>
 	void for_each(Function func) {
-		Type *object = first;
+		Section section;
+		uint32_t index = readLock(section);
+		Type *object = first.load(std::memory_order_acquire);
 		while (object != nullptr) {
+			// Callback may remove or destroy current observer
+			section.cursor = static_cast<Type*>(object->next.load(std::memory_order_acquire));
 			func(static_cast<CastType*>(object));
-			object = static_cast<Type*>(object->next);
+			object = section.cursor;
 		}
+		readUnlock(index, section);
 	}
 	template <typename CastType = Type, typename Function>
 	CastType* find(Function predicate) {
-		Type *object = first;
+		CastType *found = nullptr;
+		Section section;
+		uint32_t index = readLock(section);
+		Type *object = first.load(std::memory_order_acquire);
 		while (object != nullptr) {
-			if (predicate(static_cast<CastType*>(object)))
-				return static_cast<CastType*>(object);
-			object = static_cast<Type*>(object->next);
+			if (predicate(static_cast<CastType*>(object))) {
+				found = static_cast<CastType*>(object);
+				break;
+			}
+			object = static_cast<Type*>(object->next.load(std::memory_order_acquire));
 		}
-		return nullptr;
+		readUnlock(index, section);
+		return found;
+	}
+private:
+	uint32_t readLock(Section &section) {
+		section.list = this;
+		section.cursor = nullptr;
+		section.outer = getSections();
+		getSections() = &section;
+		uint32_t index = epoch.load() & 1;
+		readers[index].fetch_add(1);
+		return index;
+	}
+	void readUnlock(uint32_t index, Section &section) {
+		readers[index].fetch_sub(1);
+		getSections() = section.outer;
 	}
 };
 
 class Observer {
 private:
-	Observer *next = nullptr;
+	std::atomic<Observer*> next{nullptr};
+	Observer *prev = nullptr;
+	// List observer is added to
+	const void *owner = nullptr;
 	friend class LinkedObservers<Observer>;
 };
 
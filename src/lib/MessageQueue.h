@@ -0,0 +1,124 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef LIB_TOTEM_SRC_LIB_MESSAGEQUEUE
+#define LIB_TOTEM_SRC_LIB_MESSAGEQUEUE
+
+#include <atomic>
+#include <string.h>
+
+#include "core/TotemBUS.h"
+#include "ResponseSignal.h"
+
+namespace TotemLib {
+
+// Lock-free single producer, single consumer queue of received messages.
+// Message and its string are copied once into ring buffer and passed to
+// consumer in place. Producer never blocks: message is dropped if full.
+class MessageQueue {
+    struct Record {
+        uint32_t length; // Record size with string. [0] skip to buffer start
+        uint32_t tag;
+        bool isString;
+        TotemBUS::Message message;
+    };
+    static const uint32_t Align = alignof(Record);
+    uint8_t * const buffer;
+    const uint32_t size; // Power of 2
+    // Total bytes written and consumed. Position is value % size
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> dropped;
+    ResponseSignal signal;
+    volatile ResponseSignal::Waiter consumer = {};
+public:
+    MessageQueue(uint8_t *buffer, uint32_t size) : buffer(buffer), size(size) {
+        head = 0;
+        tail = 0;
+        dropped = 0;
+    }
+    // Producer. tag is passed to consumer with message
+    bool push(const TotemBUS::Message &message, uint32_t tag = 0) {
+        bool isString = message.string.data != nullptr;
+        uint32_t stringSize = isString ? message.string.length + 1 : 0;
+        uint32_t length = (sizeof(Record) + stringSize + Align - 1) & ~(Align - 1);
+        uint32_t position = head.load(std::memory_order_relaxed);
+        uint32_t offset = position % size;
+        // Record is never split. Skip buffer end if it does not fit
+        uint32_t skip = (size - offset < length) ? size - offset : 0;
+        if (length > size / 2 || size - (position - tail.load(std::memory_order_acquire)) < skip + length) {
+            dropped++;
+            return false;
+        }
+        if (skip) {
+            reinterpret_cast<Record*>(&buffer[offset])->length = 0;
+            offset = 0;
+        }
+        Record *record = reinterpret_cast<Record*>(&buffer[offset]);
+        record->length = length;
+        record->tag = tag;
+        record->isString = isString;
+        record->message = message;
+        if (isString) {
+            char *string = reinterpret_cast<char*>(record + 1);
+            memcpy(string, message.string.data, message.string.length);
+            string[message.string.length] = '\0';
+        }
+        head.store(position + skip + length, std::memory_order_release);
+        signal.notify(consumer);
+        return true;
+    }
+    // Consumer. Calls func(TotemBUS::Message &message, uint32_t tag) for up to
+    // max ([-1] all) queued messages. Message string is valid until func returns
+    template <typename Function>
+    int poll(Function func, int max = -1) {
+        int count = 0;
+        while (max < 0 || count < max) {
+            uint32_t position = tail.load(std::memory_order_relaxed);
+            if (position == head.load(std::memory_order_acquire)) break;
+            uint32_t offset = position % size;
+            Record *record = reinterpret_cast<Record*>(&buffer[offset]);
+            if (record->length == 0) {
+                tail.store(position + size - offset, std::memory_order_release);
+                continue;
+            }
+            record->message.string.data = record->isString ? reinterpret_cast<char*>(record + 1) : nullptr;
+            func(record->message, record->tag);
+            tail.store(position + record->length, std::memory_order_release);
+            count++;
+        }
+        return count;
+    }
+    // Consumer. Block until message is queued or timeout (ms)
+    bool wait(uint32_t timeout) {
+        ResponseSignal::Waiter waiter = signal.prepare();
+        consumer = waiter;
+        if (!isEmpty()) return true;
+        signal.wait(waiter, timeout);
+        return !isEmpty();
+    }
+    bool isEmpty() {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+    // Messages not queued because queue was full
+    uint32_t getDropped() {
+        return dropped;
+    }
+};
+
+// Queue with statically allocated buffer of Size bytes (power of 2)
+template <uint32_t Size>
+class StaticMessageQueue : public MessageQueue {
+    static_assert(Size != 0 && (Size & (Size - 1)) == 0, "Size must be power of 2");
+    alignas(TotemBUS::Message) uint8_t data[Size];
+public:
+    StaticMessageQueue() : MessageQueue(data, Size) { }
+};
+
+} // namespace TotemLib
+
+#endif /* LIB_TOTEM_SRC_LIB_MESSAGEQUEUE */
@@ -19,8 +19,15 @@
 #ifndef LIB_TOTEM_SRC_LIB_MODULECONTROL
 #define LIB_TOTEM_SRC_LIB_MODULECONTROL
 
+#include <atomic>
+
 #include "ModuleList.h"
 #include "TotemNetwork.h"
+#include "ResponseSignal.h"
+
+#ifndef TOTEMMODULE_WINDOW
+#define TOTEMMODULE_WINDOW 8 // Acknowledged operations in flight per module
+#endif
 
 namespace TotemLib {
 
@@ -32,9 +39,11 @@ class Control : public ModuleObject {
 public:
 	void setNumber(uint16_t number) {
 		this->number = number;
+		setListAddress(number, serial);
 	}
 	void setSerial(uint16_t serial) {
 		this->serial = serial;
+		setListAddress(number, serial);
 	}
 	uint16_t getNumber() {
 		return number;
@@ -57,76 +66,196 @@ public:
 protected:
 	Control(uint16_t number, uint16_t serial)
 	: number(number), serial(serial) {
+		setListAddress(number, serial);
 		getList().attach(*this);
 	}
 	~Control() {
 		getList().detach(*this);
 	}
 
-	virtual void onModuleMessage(int command, int value, TotemBUSProtocol::String string) = 0;
+	// Value received from module. waited: value is result of moduleReadWait()
+	virtual void onModuleMessage(int command, int value, TotemBUSProtocol::String string, bool waited) = 0;
 	
 	bool moduleWrite(int command, bool responseReq) {
-		prepareWait(command);
-		bool succ = moduleCtrlSend(TotemBUS::write(command, responseReq));
-		if (responseReq && succ) succ = waitResponse(1000);
-		return succ;
+		return moduleSendWait(command, TotemBUS::write(command, responseReq), responseReq);
 	}
-	bool moduleWrite(int command, int value, bool responseReq) {
-		prepareWait(command);
-		bool succ = moduleCtrlSend(TotemBUS::write(command, value, responseReq));
-		if (responseReq && succ) succ = waitResponse(1000);
-		return succ;
+	bool moduleWrite(int command, int value, bool responseReq, TotemBUS::Priority priority = TotemBUS::Priority::Auto, uint16_t deadline = 0) {
+		return moduleSendWait(command, TotemBUS::write(command, value, responseReq), responseReq, priority, deadline);
+	}
+	bool moduleWrite(int command, TotemBUSProtocol::String string, bool responseReq, TotemBUS::Priority priority = TotemBUS::Priority::Auto, uint16_t deadline = 0) {
+		return moduleSendWait(command, TotemBUS::write(command, string, responseReq), responseReq, priority, deadline);
+	}
+	bool moduleWrite(TotemBUS::Batch &batch, bool responseReq, TotemBUS::Priority priority = TotemBUS::Priority::Auto, uint16_t deadline = 0) {
+		if (batch.getCount() == 0) return true;
+		return moduleSendWait(batch.getLastCommand(), TotemBUS::writeBatch(batch, responseReq), responseReq, priority, deadline);
 	}
-	bool moduleWrite(int command, TotemBUSProtocol::String string, bool responseReq) {
-		prepareWait(command);
-		bool succ = moduleCtrlSend(TotemBUS::write(command, string, responseReq));
-		if (responseReq && succ) succ = waitResponse(1000);
+	// Write all values with response. Up to TOTEMMODULE_WINDOW writes are sent
+	// before waiting for acknowledgement. Returns false if any write failed
+	bool moduleWriteAll(const uint32_t *commands, const int32_t *values, int count) {
+		int window[TOTEMMODULE_WINDOW];
+		int sent = 0, done = 0;
+		bool succ = true;
+		while (done < sent || (succ && sent < count)) {
+			if (succ && sent < count && sent - done < TOTEMMODULE_WINDOW) {
+				// Block for free slot only if nothing to wait for
+				int slot = prepareWait(commands[sent], (sent == done) ? 1000 : 0);
+				if (slot >= 0) {
+					if (moduleCtrlSend(TotemBUS::write(commands[sent], values[sent], true), TotemBUS::Priority::Bulk)) {
+						window[sent++ % TOTEMMODULE_WINDOW] = slot;
+					}
+					else {
+						releaseWait(slot);
+						succ = false;
+					}
+					continue;
+				}
+				if (sent == done) {
+					succ = false;
+					continue;
+				}
+			}
+			if (!waitResponse(window[done++ % TOTEMMODULE_WINDOW], 1000)) succ = false;
+		}
 		return succ;
 	}
 	bool moduleRead(int command, bool blocking) {
-		prepareWait(command);
-		bool succ = moduleCtrlSend(TotemBUS::read(command));
-		if (blocking && succ) succ = waitResponse(1000);
-		return succ;
+		return moduleSendWait(command, TotemBUS::read(command), blocking);
+	}
+	// Read value and wait for it. String is copied to buffer of size bytes
+	// (with terminator). string.data is nullptr if value is received
+	bool moduleReadWait(int command, int32_t &value, TotemBUSProtocol::String &string, char *buffer, uint16_t size) {
+		int slot = prepareWait(command, 1000, buffer, size);
+		if (slot < 0) return false;
+		if (!moduleCtrlSend(TotemBUS::read(command))) {
+			releaseWait(slot);
+			return false;
+		}
+		if (!waitResponse(slot, 1000)) return false;
+		value = waits[slot].value;
+		string = waits[slot].string;
+		releaseWait(slot);
+		return true;
 	}
 	bool moduleSubscribe(int command, int interval, bool responseReq) {
-		prepareWait(command);
-		bool succ = moduleCtrlSend(TotemBUS::subscribe(command, interval, responseReq));
-		if (responseReq && succ) succ = waitResponse(1000);
-		return succ;
+		return moduleSendWait(command, TotemBUS::subscribe(command, interval, responseReq), responseReq);
 	}
 
 private:
 	TotemNetwork* getNetwork() {
 		return static_cast<TotemNetwork*>(getList().parent);
 	}
-	volatile struct {
-		int	command = -1;
-		bool succ = false;
-		bool waiting = false;
-	} response;
+	// Operations waiting for response. Responses of same command are
+	// matched in order operations were sent. Slot is claimed and completed
+	// by changing state with compare-exchange, so tasks never share a slot
+	enum class WaitState {
+		Free,
+		Claimed,    // Taken by prepareWait()
+		Waiting,
+		Completing, // Taken by receive path
+		Succ,
+		Fail,
+	};
+	struct {
+		int command = -1;
+		uint32_t sequence = 0;
+		bool read = false;
+		int32_t value = 0;
+		TotemBUSProtocol::String string = {nullptr, 0};
+		char *buffer = nullptr; // Owned by reading task
+		uint16_t size = 0;
+		std::atomic<WaitState> state{WaitState::Free};
+		ResponseSignal::Waiter waiter;
+	} waits[TOTEMMODULE_WINDOW];
+	std::atomic<uint32_t> waitSequence{0};
+	ResponseSignal signal;
 	uint32_t responseError = 0;
-	void giveResponse(int command, bool succ) {
-		if (response.command == command) {
-			response.succ = succ;
-			response.waiting = false;
-			response.command = -1;
+	// Prefer reads for value responses, writes for acknowledgements. [-1] any
+	int waitRank(int slot, int read) {
+		return (read < 0 || waits[slot].read == (read != 0)) ? 0 : 1;
+	}
+	// Take oldest operation waiting for command. Returns [-1] if none
+	int claimWait(int command, int read) {
+		while (true) {
+			int slot = -1;
+			for (int i=0; i<TOTEMMODULE_WINDOW; i++) {
+				if (waits[i].state.load(std::memory_order_acquire) != WaitState::Waiting || waits[i].command != command) continue;
+				if (slot >= 0) {
+					int rank = waitRank(i, read) - waitRank(slot, read);
+					if (rank > 0 || (rank == 0 && (int32_t)(waits[i].sequence - waits[slot].sequence) >= 0)) continue;
+				}
+				slot = i;
+			}
+			if (slot < 0) return -1;
+			WaitState expected = WaitState::Waiting;
+			if (waits[slot].state.compare_exchange_strong(expected, WaitState::Completing, std::memory_order_acquire)) return slot;
+			// Timed out meanwhile. Look again
+		}
+	}
+	void giveResponse(int slot, bool succ) {
+		if (slot < 0) return;
+		waits[slot].state.store(succ ? WaitState::Succ : WaitState::Fail, std::memory_order_release);
+		signal.notify(waits[slot].waiter);
+	}
+	// Take free slot. Waits up to timeout (ms) if window is full. Returns [-1] if none.
+	// Slot with buffer is read
+	int prepareWait(int command, int timeout, char *buffer = nullptr, uint16_t size = 0) {
+		uint32_t start = millis();
+		while (true) {
+			for (int i=0; i<TOTEMMODULE_WINDOW; i++) {
+				WaitState expected = WaitState::Free;
+				if (!waits[i].state.compare_exchange_strong(expected, WaitState::Claimed, std::memory_order_acquire)) continue;
+				waits[i].command = command;
+				waits[i].read = buffer != nullptr;
+				waits[i].buffer = buffer;
+				waits[i].size = size;
+				waits[i].sequence = waitSequence.fetch_add(1, std::memory_order_relaxed);
+				waits[i].waiter = signal.prepare();
+				waits[i].state.store(WaitState::Waiting, std::memory_order_release);
+				return i;
+			}
+			// Slots are released by other tasks without notification
+			if ((int)(millis() - start) >= timeout) return -1;
+			delay(1);
 		}
 	}
-	void prepareWait(int command) {
-		response.command = command;
-		response.succ = false;
-		response.waiting = true;
+	void releaseWait(int slot) {
+		waits[slot].command = -1;
+		waits[slot].state.store(WaitState::Free, std::memory_order_release);
 	}
-	bool waitResponse(int timeout) {
-		if (response.command != -1) {
-			int end = millis()+timeout;
-			while (response.waiting && end > millis()) {
-				delay(1);
+	// Block until response is received (signaled by receive path) or timeout (ms).
+	// Slot is kept for successful read, caller takes value and releases it
+	bool waitResponse(int slot, int timeout) {
+		uint32_t start = millis();
+		WaitState state;
+		while (true) {
+			ResponseSignal::Waiter waiter = signal.prepare();
+			state = waits[slot].state.load(std::memory_order_acquire);
+			if (state == WaitState::Succ || state == WaitState::Fail) break;
+			int elapsed = millis() - start;
+			if (elapsed >= timeout) {
+				// Response already taken by receive path is waited for
+				WaitState expected = WaitState::Waiting;
+				if (waits[slot].state.compare_exchange_strong(expected, WaitState::Fail, std::memory_order_acquire)) {
+					state = WaitState::Fail;
+					break;
+				}
+				elapsed = timeout - 1;
 			}
-			response.waiting = false;
+			signal.wait(waiter, timeout - elapsed);
 		}
-		return response.succ;
+		bool succ = state == WaitState::Succ;
+		if (!succ || !waits[slot].read) releaseWait(slot);
+		return succ;
+	}
+	bool moduleSendWait(int command, TotemBUS::Frame frame, bool wait, TotemBUS::Priority priority = TotemBUS::Priority::Auto, uint16_t deadline = 0) {
+		if (!wait) return moduleCtrlSend(frame, priority, deadline);
+		int slot = prepareWait(command, 1000);
+		if (slot < 0) return false;
+		if (!moduleCtrlSend(frame, priority, deadline)) {
+			releaseWait(slot);
+			return false;
+		}
+		return waitResponse(slot, 1000);
 	}
 	
 	// Check if provided identifiers are for this Function board module
@@ -135,30 +264,47 @@ private:
 		if (this->serial != 0 && this->serial != serial) return false;
 		return this->number == number;
 	}
-	bool moduleCtrlSend(TotemBUS::Frame frame) {
+	bool moduleCtrlSend(TotemBUS::Frame frame, TotemBUS::Priority priority = TotemBUS::Priority::Auto, uint16_t deadline = 0) {
 		if (getNetwork() == nullptr) return false;
-		return getNetwork()->networkSend(frame, number, serial);
+		return getNetwork()->networkSend(frame, number, serial, priority, deadline);
+	}
+	// Reader buffer is returned when receive path returns. String is kept in buffer of reading task
+	TotemBUSProtocol::String copyString(int slot, TotemBUSProtocol::String string) {
+		if (string.data == nullptr || waits[slot].size == 0) return {nullptr, 0};
+		uint32_t length = (string.length < waits[slot].size) ? string.length : waits[slot].size - 1;
+		memcpy(waits[slot].buffer, string.data, length);
+		waits[slot].buffer[length] = '\0';
+		return {waits[slot].buffer, length};
 	}
 	virtual void onModuleMessageReceive(TotemBUS::Message message) override {
 		// Validate if data received from this module
 		if (!isFromModule(message.number, message.serial)) 
 			return;
+		bool isValue = false;
 		switch (message.type) {
 			case TotemBUS::MessageType::ResponseValue:
-				onModuleMessage(message.command, message.value, {nullptr, 0}); 
+				message.string = {nullptr, 0};
+				isValue = true;
 				break;
 			case TotemBUS::MessageType::ResponseString:
-				onModuleMessage(message.command, 0, message.string); 
+				message.value = 0;
+				isValue = true;
 				break;
 			case TotemBUS::MessageType::ResponseOk:
 				break;
 			default: 
 				responseError = message.value;
-				giveResponse(message.command, false);
+				giveResponse(claimWait(message.command, -1), false);
 				return;
 		}
-
-		giveResponse(message.command, true);
+		int slot = claimWait(message.command, isValue);
+		bool waited = slot >= 0 && waits[slot].read;
+		if (waited) {
+			waits[slot].value = message.value;
+			waits[slot].string = copyString(slot, message.string);
+		}
+		if (isValue) onModuleMessage(message.command, message.value, message.string, waited);
+		giveResponse(slot, true);
 	}
 };
 
@@ -19,8 +19,16 @@
 #ifndef LIB_TOTEM_SRC_MODULES_MODULELIST
 #define LIB_TOTEM_SRC_MODULES_MODULELIST
 
+#include <atomic>
+#include <mutex>
+
 #include "core/TotemBUS.h"
 #include "LinkedObservers.h"
+#include "MessageQueue.h"
+
+#ifndef TOTEMMODULE_INDEX_BUCKETS
+#define TOTEMMODULE_INDEX_BUCKETS 32 // Hash buckets of module address index per list
+#endif
 
 namespace TotemLib {
 
@@ -35,30 +43,93 @@ void setDefaultModuleList(ModuleList&);
 
 class ModuleObject : public Observer {
 	ModuleList *customList = nullptr;
+	// Address messages are received from. Number [0] all modules, serial [0] any
+	uint16_t listNumber = 0;
+	uint16_t listSerial = 0;
+	std::atomic<ModuleObject*> indexNext{nullptr};
+	bool indexed = false; // Linked in index of customList
+	// Relocated from this list. Its dispatch may still walk the module
+	ModuleList *relocatedFrom = nullptr;
+	// Identifies module of queued event. [0] network event
+	const uint32_t listId = nextListId();
+	static uint32_t nextListId() {
+		static std::atomic<uint32_t> counter(0);
+		uint32_t id;
+		while ((id = ++counter) == 0);
+		return id;
+	}
 public:
 	virtual ~ModuleObject() {}
 protected:
 	ModuleList& getList() {
 		return customList ? *customList : getDetachedModuleList();
 	}
+	void setListAddress(uint16_t number, uint16_t serial);
 	virtual void onModuleMessageReceive(TotemBUS::Message message) = 0;
+	// Event deferred with deferModuleEvent(), called from ModuleList event poll
+	virtual void onModuleEventReceive(TotemBUS::Message message) { }
+	// Queue data for onModuleEventReceive() if list has event queue.
+	// Returns false if event should be handled immediately
+	bool deferModuleEvent(int command, int value, TotemBUSProtocol::String string);
 
 	friend class ModuleList;
 };
 
 class ModuleList {
     LinkedObservers<> container;
+	// Index of modules by address. Modules with number [0] are kept separately.
+	// Iterated inside container read section, removed entries are reused only
+	// after container.synchronize()
+	std::atomic<ModuleObject*> index[TOTEMMODULE_INDEX_BUCKETS];
+	std::atomic<ModuleObject*> wildcards;
+	// Serializes attach, detach, address change and relocation.
+	// Not held while waiting for running dispatch
+	std::mutex writeLock;
+	MessageQueue *eventQueue = nullptr;
+	// Index walks of calling task, innermost first. Removal from module
+	// callback moves cursor past removed module. Walk of chain relocated
+	// to other list is moved too
+	struct Walk {
+		ModuleObject *cursor;
+		Walk *outer;
+	};
+	static Walk *&getWalks() {
+		static thread_local Walk *walks = nullptr;
+		return walks;
+	}
 public:
 	ModuleList(void *parent) : parent(parent) 
-	{ }
+	{
+		indexClear();
+	}
     void attach(ModuleObject &module) {
 		module.getList().detach(module);
+		std::lock_guard<std::mutex> lock(writeLock);
 		container.add(module);
+		indexAdd(module);
 		module.customList = this;
 	}
 	void detach(ModuleObject &module) {
-		container.remove(module);
-		module.customList = nullptr;
+		bool linked;
+		ModuleList *relocatedFrom;
+		{
+			std::unique_lock<std::mutex> lock(writeLock);
+			ModuleList *list = module.customList;
+			if (list != nullptr && list != this) {
+				// Relocated before lock was taken
+				lock.unlock();
+				list->detach(module);
+				return;
+			}
+			indexRemove(module);
+			linked = container.unlink(module);
+			module.customList = nullptr;
+			relocatedFrom = module.relocatedFrom;
+			module.relocatedFrom = nullptr;
+		}
+		// Wait for running dispatch, index entry is unused after it
+		if (linked) container.synchronize();
+		if (relocatedFrom) relocatedFrom->container.synchronize();
 	}
 protected:
 	void * const parent;
@@ -81,28 +152,212 @@ protected:
         // Move all assigned modules to detached list
         moduleListRelocateTo(getDetachedModuleList());
 	}
+	// Index chains of list are appended to chains of this list, so modules
+	// receive messages of this list at once. Dispatch of list may still walk
+	// moved modules until it is synchronized. Detach and readdress wait for it
 	void moduleListRelocateFrom(ModuleList &list) {
-		container.moveFrom(list.container);
+		{
+			std::lock(writeLock, list.writeLock);
+			std::lock_guard<std::mutex> lock(writeLock, std::adopt_lock);
+			std::lock_guard<std::mutex> listLock(list.writeLock, std::adopt_lock);
+			for (int i=0; i<TOTEMMODULE_INDEX_BUCKETS; i++) indexSplice(index[i], list.index[i]);
+			indexSplice(wildcards, list.wildcards);
+			list.container.for_each<ModuleObject>([&](ModuleObject *module){
+				module->customList = this;
+				module->relocatedFrom = &list;
+			});
+			container.moveFrom(list.container);
+		}
+		list.container.synchronize();
+		std::lock_guard<std::mutex> lock(writeLock);
 		container.for_each<ModuleObject>([&](ModuleObject *module){
-			module->customList = this;
+			if (module->relocatedFrom == &list) module->relocatedFrom = nullptr;
 		});
 	}
 	void moduleListRelocateTo(ModuleList &list) {
 		list.moduleListRelocateFrom(*this);
 	}
 
+	// Pass message to modules of its address, modules of its number with
+	// any serial and modules without number
 	void moduleListCallMessageReceive(TotemBUS::Message &message) {
-		container.for_each<ModuleObject>([&](ModuleObject *module){
-			module->onModuleMessageReceive(message);
+		container.read([&]() {
+			if (message.number != 0) {
+				indexCallMessageReceive(index[indexHash(message.number, message.serial)].load(std::memory_order_acquire), message, message.serial);
+				if (message.serial != 0)
+					indexCallMessageReceive(index[indexHash(message.number, 0)].load(std::memory_order_acquire), message, 0);
+			}
+			indexWalk(wildcards.load(std::memory_order_acquire), [&](ModuleObject *module) {
+				module->onModuleMessageReceive(message);
+			});
 		});
 	}
 
+	// Module events are queued and called from moduleListPollEvents()
+	void moduleListSetEventQueue(MessageQueue *queue) {
+		eventQueue = queue;
+	}
+	bool moduleListDeferEvent(TotemBUS::Message &message, uint32_t tag = 0) {
+		MessageQueue *queue = eventQueue;
+		if (queue == nullptr) return false;
+		// Dropped event is not handled immediately
+		queue->push(message, tag);
+		return true;
+	}
+	// Call queued events. Network events (tag [0]) are passed to onEvent
+	template <typename Function>
+	int moduleListPollEvents(int max, Function onEvent) {
+		MessageQueue *queue = eventQueue;
+		if (queue == nullptr) return 0;
+		return queue->poll([&](TotemBUS::Message &message, uint32_t tag) {
+			if (tag == 0) {
+				onEvent(message);
+				return;
+			}
+			// Module may be detached or destroyed since event was queued
+			container.read([&]() {
+				ModuleObject *module = (message.number == 0) ? wildcards.load(std::memory_order_acquire)
+					: index[indexHash(message.number, message.serial)].load(std::memory_order_acquire);
+				for (; module != nullptr; module = module->indexNext.load(std::memory_order_acquire)) {
+					if (module->listId != tag) continue;
+					module->onModuleEventReceive(message);
+					return;
+				}
+			});
+		}, max);
+	}
+	bool moduleListWaitEvents(uint32_t timeout) {
+		MessageQueue *queue = eventQueue;
+		if (queue == nullptr) return false;
+		return queue->wait(timeout);
+	}
+
 	ModuleList& moduleListGet() {
 		return *this;
 	}
 	friend Module::Control;
+	friend ModuleObject;
+private:
+	static uint32_t indexHash(uint16_t number, uint16_t serial) {
+		uint32_t key = ((uint32_t)number << 16 | serial) * 0x9E3779B1u;
+		return (key ^ (key >> 16)) % TOTEMMODULE_INDEX_BUCKETS;
+	}
+	std::atomic<ModuleObject*>& indexBucket(ModuleObject &module) {
+		if (module.listNumber == 0) return wildcards;
+		return index[indexHash(module.listNumber, module.listSerial)];
+	}
+	// Index is changed with writeLock held. Module already linked is skipped
+	void indexAdd(ModuleObject &module) {
+		if (module.indexed) return;
+		std::atomic<ModuleObject*> &bucket = indexBucket(module);
+		module.indexNext.store(bucket.load(), std::memory_order_relaxed);
+		bucket.store(&module, std::memory_order_release);
+		module.indexed = true;
+	}
+	// Removed module keeps indexNext for running dispatch
+	void indexRemove(ModuleObject &module) {
+		if (!module.indexed) return;
+		module.indexed = false;
+		ModuleObject *next = module.indexNext.load();
+		for (Walk *walk = getWalks(); walk != nullptr; walk = walk->outer) {
+			if (walk->cursor == &module) walk->cursor = next;
+		}
+		std::atomic<ModuleObject*> *it = &indexBucket(module);
+		while (it->load() != nullptr) {
+			if (it->load() == &module) {
+				it->store(next, std::memory_order_release);
+				return;
+			}
+			it = &it->load()->indexNext;
+		}
+	}
+	// Append chain of other list. Linked modules keep indexNext
+	void indexSplice(std::atomic<ModuleObject*> &bucket, std::atomic<ModuleObject*> &moved) {
+		ModuleObject *chain = moved.load();
+		if (chain == nullptr) return;
+		moved.store(nullptr, std::memory_order_release);
+		ModuleObject *tail = bucket.load();
+		if (tail == nullptr) {
+			bucket.store(chain, std::memory_order_release);
+			return;
+		}
+		while (tail->indexNext.load() != nullptr) tail = tail->indexNext.load();
+		tail->indexNext.store(chain, std::memory_order_release);
+	}
+	void indexClear() {
+		for (auto &bucket : index) {
+			for (ModuleObject *module = bucket.load(); module != nullptr; module = module->indexNext.load())
+				module->indexed = false;
+			bucket = nullptr;
+		}
+		for (ModuleObject *module = wildcards.load(); module != nullptr; module = module->indexNext.load())
+			module->indexed = false;
+		wildcards = nullptr;
+	}
+	// Call func for modules of chain. Next module is taken before call
+	template <typename Function>
+	void indexWalk(ModuleObject *module, Function func) {
+		Walk walk = {nullptr, getWalks()};
+		getWalks() = &walk;
+		while (module != nullptr) {
+			walk.cursor = module->indexNext.load(std::memory_order_acquire);
+			func(module);
+			module = walk.cursor;
+		}
+		getWalks() = walk.outer;
+	}
+	void indexCallMessageReceive(ModuleObject *module, TotemBUS::Message &message, uint16_t serial) {
+		indexWalk(module, [&](ModuleObject *module) {
+			// Bucket is shared by other addresses
+			if (module->listNumber == message.number && module->listSerial == serial)
+				module->onModuleMessageReceive(message);
+		});
+	}
 };
 
+inline bool ModuleObject::deferModuleEvent(int command, int value, TotemBUSProtocol::String string) {
+	TotemBUS::Message message;
+	message.type = string.data ? TotemBUS::MessageType::ResponseString : TotemBUS::MessageType::ResponseValue;
+	// Address of module in index
+	message.number = listNumber;
+	message.serial = listSerial;
+	message.command = command;
+	message.value = value;
+	message.string = string;
+	return getList().moduleListDeferEvent(message, listId);
+}
+// Change address in index of list module is attached to
+inline void ModuleObject::setListAddress(uint16_t number, uint16_t serial) {
+	ModuleList *list, *from;
+	while (true) {
+		list = customList;
+		if (list == nullptr) {
+			listNumber = number;
+			listSerial = serial;
+			return;
+		}
+		std::lock_guard<std::mutex> lock(list->writeLock);
+		// Relocated before lock was taken
+		if (customList != list) continue;
+		list->indexRemove(*this);
+		listNumber = number;
+		listSerial = serial;
+		from = relocatedFrom;
+		break;
+	}
+	// Entry is reused after running dispatch finishes. Inside dispatch of
+	// the list it is reused at once, walk of calling task is already past it
+	list->container.synchronize();
+	if (from) from->container.synchronize();
+	// Relocated meanwhile: added to index of new list
+	while ((list = customList) != nullptr) {
+		std::lock_guard<std::mutex> lock(list->writeLock);
+		if (customList != list) continue;
+		list->indexAdd(*this);
+		return;
+	}
+}
+
 } // namespace TotemLib
 
 #endif /* LIB_TOTEM_SRC_MODULES_MODULELIST */
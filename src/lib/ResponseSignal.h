@@ -0,0 +1,108 @@
+/*
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef LIB_TOTEM_SRC_LIB_RESPONSESIGNAL
+#define LIB_TOTEM_SRC_LIB_RESPONSESIGNAL
+
+#if defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#elif !defined(ARDUINO)
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace TotemLib {
+
+// Wakes task blocked on module response as soon as it is received.
+// Usage: waiter = prepare(), check condition, wait(waiter, timeout). Notify
+// arriving between check and wait() is not lost. wait() may return early:
+// condition is checked again after every wakeup
+#if defined(ESP_PLATFORM) && configTASK_NOTIFICATION_ARRAY_ENTRIES > 1
+// Task notification of waiting task. Uses own index: notification [0] is
+// left to application and libraries (e.g. xTaskNotifyGive of other code)
+#ifndef TOTEM_NOTIFY_INDEX
+#define TOTEM_NOTIFY_INDEX (configTASK_NOTIFICATION_ARRAY_ENTRIES - 1)
+#endif
+class ResponseSignal {
+public:
+    using Waiter = TaskHandle_t;
+    Waiter prepare() {
+        return xTaskGetCurrentTaskHandle();
+    }
+    void notify(Waiter waiter) {
+        if (waiter) xTaskNotifyGiveIndexed(waiter, TOTEM_NOTIFY_INDEX);
+    }
+    void wait(Waiter waiter, uint32_t timeout) {
+        TickType_t ticks = pdMS_TO_TICKS(timeout);
+        ulTaskNotifyTakeIndexed(TOTEM_NOTIFY_INDEX, pdTRUE, ticks ? ticks : 1);
+    }
+};
+#elif defined(ESP_PLATFORM)
+// Single notification per task is used by application. Binary semaphore of
+// waiting task instead. Give left from earlier response only wakes it early
+class ResponseSignal {
+public:
+    using Waiter = SemaphoreHandle_t;
+    Waiter prepare() {
+        static thread_local StaticSemaphore_t buffer;
+        static thread_local SemaphoreHandle_t semaphore = nullptr;
+        if (semaphore == nullptr) semaphore = xSemaphoreCreateBinaryStatic(&buffer);
+        return semaphore;
+    }
+    void notify(Waiter waiter) {
+        if (waiter) xSemaphoreGive(waiter);
+    }
+    void wait(Waiter waiter, uint32_t timeout) {
+        TickType_t ticks = pdMS_TO_TICKS(timeout);
+        xSemaphoreTake(waiter, ticks ? ticks : 1);
+    }
+};
+#elif !defined(ARDUINO)
+// Host: condition variable. Waiter is notify count at prepare()
+class ResponseSignal {
+    std::mutex mutex;
+    std::condition_variable condition;
+    uint32_t notified = 0;
+public:
+    using Waiter = uint32_t;
+    Waiter prepare() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return notified;
+    }
+    void notify(Waiter waiter) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            notified++;
+        }
+        condition.notify_all();
+    }
+    void wait(Waiter waiter, uint32_t timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait_for(lock, std::chrono::milliseconds(timeout), [&]() { return notified != waiter; });
+    }
+};
+#else
+// Boards without RTOS: poll
+class ResponseSignal {
+public:
+    using Waiter = uint8_t;
+    Waiter prepare() {
+        return 0;
+    }
+    void notify(Waiter waiter) { }
+    void wait(Waiter waiter, uint32_t timeout) {
+        delay(1);
+    }
+};
+#endif
+
+} // namespace TotemLib
+
+#endif /* LIB_TOTEM_SRC_LIB_RESPONSESIGNAL */
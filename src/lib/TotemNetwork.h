@@ -43,16 +43,43 @@ public:
         }
     }
     
+    // Module data receivers and module connected event are queued instead of
+    // called from receive context. Call pollEvents() from loop or own task.
+    // [nullptr] call directly (default)
+    void setEventQueue(MessageQueue *queue) {
+        moduleListSetEventQueue(queue);
+    }
+    // Call queued events. Returns number of events called
+    int pollEvents(int max = -1) {
+        return moduleListPollEvents(max, [this](TotemBUS::Message &message) {
+            if (onConnectedReceiver) onConnectedReceiver(message.number, message.serial);
+        });
+    }
+    // Block until event is queued or timeout (ms)
+    bool waitEvents(uint32_t timeout) {
+        return moduleListWaitEvents(timeout);
+    }
+
     virtual bool networkSend(TotemBUS::Frame &frame, int number, int serial) = 0;
+    // Control frames are transmitted ahead of queued Bulk frames.
+    // Frame with deadline (ms) is dropped if still queued after it passes
+    bool networkSend(TotemBUS::Frame &frame, int number, int serial, TotemBUS::Priority priority, uint16_t deadline = 0) {
+        frame.priority = priority;
+        frame.deadline = deadline;
+        return networkSend(frame, number, serial);
+    }
 protected:
     virtual void onMessageReceive(TotemBUS::Message &message) {
         // If received ping
         if (message.type == TotemBUS::MessageType::ResponsePing) {
-            if (onConnectedReceiver) {
+            if (onConnectedReceiver && !moduleListDeferEvent(message)) {
                 onConnectedReceiver(message.number, message.serial);
             }
             return;
         }
+        // Handled by TotemBUS
+        if (message.type == TotemBUS::MessageType::RequestCapabilities
+        || message.type == TotemBUS::MessageType::ResponseCapabilities) return;
         moduleListCallMessageReceive(message);
     }
 private:
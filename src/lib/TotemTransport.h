@@ -0,0 +1,42 @@
+/* 
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef LIB_TOTEM_SRC_LIB_TOTEMTRANSPORT
+#define LIB_TOTEM_SRC_LIB_TOTEMTRANSPORT
+
+#include "core/TotemBUS.h"
+
+namespace TotemLib {
+
+// Link carrying TotemBUS CAN packets between network and modules
+class TotemTransport {
+public:
+    class Receiver {
+    public:
+        virtual void onTransportReceive(uint32_t id, uint8_t *data, uint8_t len) = 0;
+    };
+    virtual ~TotemTransport() { }
+
+    void setReceiver(Receiver *receiver) {
+        this->receiver = receiver;
+    }
+    // Send all packets of single message
+    virtual bool transportSend(TotemBUSProtocol::CanPacket *packets, size_t count) = 0;
+    // Pass received packets to Receiver. Waits up to "timeout" ms if nothing is received.
+    // Returns amount of packets processed
+    virtual int transportPoll(int timeout) = 0;
+protected:
+    void transportReceive(uint32_t id, uint8_t *data, uint8_t len) {
+        if (receiver) receiver->onTransportReceive(id, data, len);
+    }
+private:
+    Receiver *receiver = nullptr;
+};
+
+} // namespace TotemLib
+
+#endif /* LIB_TOTEM_SRC_LIB_TOTEMTRANSPORT */
@@ -0,0 +1,75 @@
+/* 
+ * Copyright 2026 Totem Technology, UAB
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#ifndef LIB_TOTEM_SRC_LIB_TRANSPORTNETWORK
+#define LIB_TOTEM_SRC_LIB_TRANSPORTNETWORK
+
+#include "TotemNetwork.h"
+#include "TotemTransport.h"
+
+namespace TotemLib {
+
+// TotemNetwork running over any TotemTransport (loopback, UDP, ...)
+class TransportNetwork : public TotemNetwork, protected TotemTransport::Receiver {
+    TotemBUS::Memory<8, 256> memory;
+    TotemBUS totemBUS;
+    TotemTransport &transport;
+public:
+    TransportNetwork(TotemTransport &transport) :
+    totemBUS(memory, this, onTotemBUSCANSend, onTotemBUSMessageReceive),
+    transport(transport)
+    {
+        totemBUS.setCANSendBatch(onTotemBUSCANSendBatch);
+        transport.setReceiver(this);
+    }
+    ~TransportNetwork() {
+        transport.setReceiver(nullptr);
+        moduleListMainReset();
+    }
+    // Assign detached modules to this network
+    void begin() {
+        moduleListMainSet();
+    }
+    void end() {
+        moduleListMainReset();
+    }
+    // Process received packets. Call from loop or dedicated thread
+    int poll(int timeout = 0) {
+        return transport.transportPoll(timeout);
+    }
+    void setCapabilities(uint8_t flags) {
+        totemBUS.setCapabilities(flags);
+    }
+    // Advertise capabilities to module. Used after module responds with them
+    bool negotiate(uint16_t number, uint16_t serial) {
+        return totemBUS.negotiate(number, serial);
+    }
+
+    using TotemNetwork::networkSend;
+    bool networkSend(TotemBUS::Frame &frame, int number, int serial) override {
+        return frame.send(totemBUS, number, serial);
+    }
+protected:
+    void onTransportReceive(uint32_t id, uint8_t *data, uint8_t len) override {
+        totemBUS.processCAN(id, data, len);
+    }
+private:
+    static bool onTotemBUSCANSend(void *context, TotemBUSProtocol::CanPacket &packet) {
+        return static_cast<TransportNetwork*>(context)->transport.transportSend(&packet, 1);
+    }
+    static bool onTotemBUSCANSendBatch(void *context, TotemBUS::PacketBatch &batch) {
+        return static_cast<TransportNetwork*>(context)->transport.transportSend(batch.packets, batch.count);
+    }
+    static bool onTotemBUSMessageReceive(void *context, TotemBUS::Message message) {
+        static_cast<TransportNetwork*>(context)->onMessageReceive(message);
+        return true;
+    }
+};
+
+} // namespace TotemLib
+
+#endif /* LIB_TOTEM_SRC_LIB_TRANSPORTNETWORK */
@@ -51,29 +51,59 @@ public:
     /// @return BLE address
     String getAddress() { return ble.getAddress(); }
 
+    /// @brief Start collecting motor, servo, LED and other value writes.
+    /// Collected writes are sent in single message with sendBatch()
+    void beginBatch() { ble.beginBatch(); }
+    /// @brief Send writes collected after beginBatch() in single message
+    /// @return [true] sent, [false] failed
+    bool sendBatch() { return ble.sendBatch(); }
+    /// @brief Drop motor, servo, LED and other value writes not sent within given time.
+    /// Outdated setpoints are not sent after connection stall
+    /// @param ms [1:65535] deadline in milliseconds. [0] no limit
+    void setWriteDeadline(int ms) { ble.setWriteDeadline(ms); }
+    /// @brief Get number of CAN packets dropped because write deadline passed
+    /// @return dropped packet count
+    uint32_t getExpiredCount() { return ble.getExpiredCount(); }
+    /// @brief Get number of CAN packets dropped because no transmit buffer was free
+    /// @return dropped packet count
+    uint32_t getDroppedCount() { return ble.getDroppedCount(); }
+    /// @brief Call value and string events from own task instead of Bluetooth receive task.
+    /// Slow event handler does not delay responses of readValue()
+    /// @param priority [1:24] FreeRTOS task priority. [0] call from Bluetooth task (default)
+    void setEventTask(int priority) { ble.setEventTask(priority); }
+    /// @brief Call value and string events only from pollEvents()
+    /// @param enable [true] queue events, [false] call from Bluetooth task (default)
+    void setEventPolling(bool enable) { ble.setEventPolling(enable); }
+    /// @brief Call events queued after setEventPolling(true). Use in loop()
+    /// @return number of events called
+    int pollEvents() { return ble.pollEvents(); }
+    /// @brief Get number of events dropped because event queue was full
+    /// @return dropped event count
+    uint32_t getDroppedEvents() { return ble.getDroppedEvents(); }
+
     /// @brief Restart board
-    void restart() { ble.cmdWrite("restart"); }
+    void restart() { ble.cmdWrite("restart"_cmd); }
     /// @brief Reset stored configuration
-    void resetConfig() { ble.cmdWrite("cfg/reset"); }
+    void resetConfig() { ble.cmdWrite("cfg/reset"_cmd); }
     /// @brief Invert all DC motor ports (change is saved to memory)
     /// @param state [true] invert, [false] not inverted
-    void setInvertDC(bool state) { ble.cmdWrite("cfg/motorABCD/invert", state?0x01010101:0x0); }
+    void setInvertDC(bool state) { ble.cmdWrite("cfg/motorABCD/invert"_cmd, state?0x01010101:0x0); }
     /// @brief Brake all DC motors when stop (change is saved to memory)
     /// @param state [true] brake, [false] coast
-    void setAutobrakeDC(bool state) { ble.cmdWrite("cfg/motorABCD/autobrake", state?0x01010101:0x0); }
+    void setAutobrakeDC(bool state) { ble.cmdWrite("cfg/motorABCD/autobrake"_cmd, state?0x01010101:0x0); }
     /// @brief Get if all DC motor ports are inverted
     /// @return [true] invert, [false] not inverted
-    bool getInvertDC() { return ble.cmdReadValue("cfg/motorABCD/invert")!=0; }
+    bool getInvertDC() { return ble.cmdReadValue("cfg/motorABCD/invert"_cmd)!=0; }
     /// @brief Get if all DC motor autobrake is enabled
     /// @return [true] brake, [false] coast
-    bool getAutobrakeDC() { return ble.cmdReadValue("cfg/motorABCD/autobrake")!=0; }
+    bool getAutobrakeDC() { return ble.cmdReadValue("cfg/motorABCD/autobrake"_cmd)!=0; }
 
     /// @brief Change board name (change is saved to memory)
     /// @param name board discovery name (30 bytes max)
-    void setName(const char *name) { ble.cmdWrite("cfg/robot/name", name); }
+    void setName(const char *name) { ble.cmdWrite("cfg/robot/name"_cmd, name); }
     /// @brief Change board initial color (change is saved to memory)
     /// @param hex [0:0xFFFFFF] HEX color
-    void setColor(uint32_t hex) { ble.cmdWrite("cfg/robot/color", hex); }
+    void setColor(uint32_t hex) { ble.cmdWrite("cfg/robot/color"_cmd, hex); }
     /// @brief Change board initial color (change is saved to memory)
     /// @param red [0:255] red
     /// @param green [0:255] green
@@ -81,25 +111,25 @@ public:
     void setColor(uint8_t red, uint8_t green, uint8_t blue) { setColor(red<<16|green<<8|blue); }
     /// @brief Assign type of robot board is installed in
     /// @param model [0:0xFFFF] identifier
-    void setModel(uint16_t model) { ble.cmdWrite("cfg/robot/model", model); }
+    void setModel(uint16_t model) { ble.cmdWrite("cfg/robot/model"_cmd, model); }
     /// @brief Get board name
     /// @return board name
-    String getName() { return ble.cmdReadString("cfg/robot/name"); }
+    String getName() { return ble.cmdReadString("cfg/robot/name"_cmd); }
     /// @brief Get type of robot board is installed in
     /// @return 16-bit identifier
-    uint16_t getModel() { return ble.cmdReadValue("cfg/robot/model"); }
+    uint16_t getModel() { return ble.cmdReadValue("cfg/robot/model"_cmd); }
     /// @brief Get board color
     /// @return [0:0xFFFFFF] HEX color
-    uint32_t getColor() { return ble.cmdReadValue("cfg/robot/color"); }
+    uint32_t getColor() { return ble.cmdReadValue("cfg/robot/color"_cmd); }
 
     /// @brief Read battery voltage
     /// @return voltage in millivolts
-    int getBattery() { return ble.cmdReadValue("battery"); }
+    int getBattery() { return ble.cmdReadValue("battery"_cmd); }
 
     /// @brief Get firmware version
     /// @return version string
     String getVersion() {
-        uint32_t version = ble.cmdReadValue("version");
+        uint32_t version = ble.cmdReadValue("version"_cmd);
         char buffer[20];
         if (boardID == 0x03) {
             snprintf(buffer, sizeof(buffer), "%d.%d", (int)(version/100), (int)(version%100));
@@ -115,7 +145,7 @@ public:
     /// @brief Get board revision
     /// @return revision string
     String getRevision() {
-        uint32_t revision = ble.cmdReadValue("revision");
+        uint32_t revision = ble.cmdReadValue("revision"_cmd);
         if (boardID == 0x03) revision /= 10;
         char buffer[4];
         buffer[0] = '0'+ (revision / 10);
@@ -127,63 +157,63 @@ public:
 
     /// @brief Spin servo A
     /// @param pos [-100:100]% position. [0] center
-    void servoSpinA(int pos) { ble.cmdWrite("servoA", pos); }
+    void servoSpinA(int pos) { ble.cmdWrite("servoA"_cmd, pos); }
     /// @brief Spin servo B
     /// @param pos [-100:100]% position. [0] center
-    void servoSpinB(int pos) { ble.cmdWrite("servoB", pos); }
+    void servoSpinB(int pos) { ble.cmdWrite("servoB"_cmd, pos); }
 
     /// @brief Spin DC motor A
     /// @param power [-100:100]% power. [0] stop
-    void dcSpinA(int power) { ble.cmdWrite("motorA", power); }
+    void dcSpinA(int power) { ble.cmdWrite("motorA"_cmd, power); }
     /// @brief Spin DC motor B
     /// @param power [-100:100]% power. [0] stop
-    void dcSpinB(int power) { ble.cmdWrite("motorB", power); }
+    void dcSpinB(int power) { ble.cmdWrite("motorB"_cmd, power); }
     /// @brief Spin DC motor C
     /// @param power [-100:100]% power. [0] stop
-    void dcSpinC(int power) { ble.cmdWrite("motorC", power); }
+    void dcSpinC(int power) { ble.cmdWrite("motorC"_cmd, power); }
     /// @brief Spin DC motor D
     /// @param power [-100:100]% power. [0] stop
-    void dcSpinD(int power) { ble.cmdWrite("motorD", power); }
+    void dcSpinD(int power) { ble.cmdWrite("motorD"_cmd, power); }
     /// @brief Brake DC motor A
     /// @param power [0:100]% power. Default 100%
-    void dcBrakeA(int power = 100) { ble.cmdWrite("motorA/brake", power); }
+    void dcBrakeA(int power = 100) { ble.cmdWrite("motorA/brake"_cmd, power); }
     /// @brief Brake DC motor B
     /// @param power [0:100]% power. Default 100%
-    void dcBrakeB(int power = 100) { ble.cmdWrite("motorB/brake", power); }
+    void dcBrakeB(int power = 100) { ble.cmdWrite("motorB/brake"_cmd, power); }
     /// @brief Brake DC motor C
     /// @param power [0:100]% power. Default 100%
-    void dcBrakeC(int power = 100) { ble.cmdWrite("motorC/brake", power); }
+    void dcBrakeC(int power = 100) { ble.cmdWrite("motorC/brake"_cmd, power); }
     /// @brief Brake DC motor D
     /// @param power [0:100]% power. Default 100%
-    void dcBrakeD(int power = 100) { ble.cmdWrite("motorD/brake", power); }
+    void dcBrakeD(int power = 100) { ble.cmdWrite("motorD/brake"_cmd, power); }
     /// @brief Spin all DC motors with singe command
     /// @param motorA [-100:100]% power. [0] stop
     /// @param motorB [-100:100]% power. [0] stop
     /// @param motorC [-100:100]% power. [0] stop
     /// @param motorD [-100:100]% power. [0] stop
-    void dcSpinABCD(int motorA, int motorB, int motorC, int motorD) { ble.cmdWrite("motorABCD", ((uint8_t)motorA)<<24|((uint8_t)motorB)<<16|((uint8_t)motorC)<<8|((uint8_t)motorD)); }
+    void dcSpinABCD(int motorA, int motorB, int motorC, int motorD) { ble.cmdWrite("motorABCD"_cmd, ((uint8_t)motorA)<<24|((uint8_t)motorB)<<16|((uint8_t)motorC)<<8|((uint8_t)motorD)); }
     /// @brief Brake all DC motors with single command
     /// @param motorA [0:100]% power. Default 100%
     /// @param motorB [0:100]% power. Default 100%
     /// @param motorC [0:100]% power. Default 100%
     /// @param motorD [0:100]% power. Default 100%
-    void dcBrakeABCD(int motorA=100, int motorB=100, int motorC=100, int motorD=100) { ble.cmdWrite("motorABCD/brake", ((uint8_t)motorA)<<24|((uint8_t)motorB)<<16|((uint8_t)motorC)<<8|((uint8_t)motorD)); }
+    void dcBrakeABCD(int motorA=100, int motorB=100, int motorC=100, int motorD=100) { ble.cmdWrite("motorABCD/brake"_cmd, ((uint8_t)motorA)<<24|((uint8_t)motorB)<<16|((uint8_t)motorC)<<8|((uint8_t)motorD)); }
 
     /// @brief Set color to all RGB lights
     /// @param hex [0:0xFFFFFF] HEX color
-    void rgbColor(uint32_t hex) { ble.cmdWrite("rgbAll", (0xFF<<24)|hex); }
+    void rgbColor(uint32_t hex) { ble.cmdWrite("rgbAll"_cmd, (0xFF<<24)|hex); }
     /// @brief Set color to RGB light A
     /// @param hex [0:0xFFFFFF] HEX color
-    void rgbColorA(uint32_t hex) { ble.cmdWrite("rgbA", (0xFF<<24)|hex); }
+    void rgbColorA(uint32_t hex) { ble.cmdWrite("rgbA"_cmd, (0xFF<<24)|hex); }
     /// @brief Set color to RGB light B
     /// @param hex [0:0xFFFFFF] HEX color
-    void rgbColorB(uint32_t hex) { ble.cmdWrite("rgbB", (0xFF<<24)|hex); }
+    void rgbColorB(uint32_t hex) { ble.cmdWrite("rgbB"_cmd, (0xFF<<24)|hex); }
     /// @brief Set color to RGB light C
     /// @param hex [0:0xFFFFFF] HEX color
-    void rgbColorC(uint32_t hex) { ble.cmdWrite("rgbC", (0xFF<<24)|hex); }
+    void rgbColorC(uint32_t hex) { ble.cmdWrite("rgbC"_cmd, (0xFF<<24)|hex); }
     /// @brief Set color to RGB light D
     /// @param hex [0:0xFFFFFF] HEX color
-    void rgbColorD(uint32_t hex) { ble.cmdWrite("rgbD", (0xFF<<24)|hex); }
+    void rgbColorD(uint32_t hex) { ble.cmdWrite("rgbD"_cmd, (0xFF<<24)|hex); }
     /// @brief Set color to all RGB lights
     /// @param red [0:255] red
     /// @param green [0:255] green
@@ -210,9 +240,9 @@ public:
     /// @param blue [0:255] blue
     void rgbColorD(uint8_t red, uint8_t green, uint8_t blue) { rgbColorD((red<<16)|(green<<8)|(blue)); }
     /// @brief Set Totem color to all RGB lights
-    void rgbColorTotem() { ble.cmdWrite("rgbAll/totem"); }
+    void rgbColorTotem() { ble.cmdWrite("rgbAll/totem"_cmd); }
     /// @brief Reset RGB lights to board color
-    void rgbColorReset() { ble.cmdWrite("rgbAll/reset"); }
+    void rgbColorReset() { ble.cmdWrite("rgbAll/reset"_cmd); }
 };
 
 } // namespace _Totem::BLE
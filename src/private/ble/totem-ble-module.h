@@ -10,22 +10,52 @@
 
 #include <BLEDevice.h>
 
+// Library headers include std headers. Keep them out of namespace
+#include "api/TotemRobot.h"
+#include "interfaces/ble/TotemBLENetwork.h"
+#include "interfaces/ble/TotemCANService.h"
+
 namespace _Totem::BLE {
 
 #include "totem-ble-scanner.h"
 
-#include "api/TotemRobot.h"
-#include "interfaces/ble/TotemBLENetwork.h"
-#include "interfaces/ble/TotemCANService.h"
+#ifndef TOTEMBLE_PENDING_READS
+#define TOTEMBLE_PENDING_READS 8 // Reads waiting for response (all tasks)
+#endif
+#ifndef TOTEMBLE_LATE_RESPONSE_MS
+#define TOTEMBLE_LATE_RESPONSE_MS 1000 // Response of timed out read is dropped within
+#endif
 
 class TotemBLEModule : protected TotemCANServiceReceiver, protected BLEClientCallbacks {
     TotemCANService canService;
-    TotemBUS::Memory<1, 128> memory;
+    TotemBUS::LeasedMemory<2> memory{TotemLib::BufferArena::shared().readerSource(128)};
     TotemBUS totemBUS;
     BLEClient *client;
     BLEAddress bleAddress = {BLEAddress("")};
-    TaskHandle_t xTaskUser = nullptr;
-    uint32_t xTaskCommand = 0;
+    // Correlation table of reads waiting for response. Responses of same
+    // command and type are matched to requests in order they were sent.
+    // Concurrent reads of same command and kind share single request (request
+    // is sequence of slot that sent it). Slot of timed out request is kept
+    // expired for TOTEMBLE_LATE_RESPONSE_MS to drop its late response
+    struct PendingRead {
+        TaskHandle_t task; // [nullptr] free or expired slot
+        TotemLib::ResponseSignal::Waiter waiter;
+        uint32_t command;
+        uint32_t sequence;
+        uint32_t request;
+        bool isString;
+        bool isRequest; // Sent as RequestValue, RequestString instead of read
+        bool done;
+        bool failed;
+        bool skipped; // Response was taken by expired request before
+        bool expired;
+        TickType_t expiredTime;
+        int32_t value;
+        String string;
+    } pendingReads[TOTEMBLE_PENDING_READS] = {};
+    uint32_t pendingSequence = 0;
+    TotemLib::ResponseSignal pendingSignal;
+    SemaphoreHandle_t pendingMutex;
     void (*onConnectionChangeClbk)() = nullptr;
     void (*onConnectionChangeClbkArg)(void *arg) = nullptr;
     void *onConnectionChangeArg = nullptr;
@@ -35,12 +65,29 @@ class TotemBLEModule : protected TotemCANServiceReceiver, protected BLEClientCal
     void (*onStringClbk)(int id, String string) = nullptr;
     void (*onStringClbkArg)(int id, String string, void *arg) = nullptr;
     void *onStringArg = nullptr;
+    void (*onStringChunkClbk)(int id, const char *data, int len, int offset, int total) = nullptr;
+    void (*onStringChunkClbkArg)(int id, const char *data, int len, int offset, int total, void *arg) = nullptr;
+    void *onStringChunkArg = nullptr;
+    TotemBUS::BatchMemory<16> batch;
+    bool batching = false;
+    uint16_t writeDeadline = 0;
+    bool nativeFraming = false;
+    // Value and string callbacks are queued instead of called from BLE
+    // receive context. Responses of pending reads are never queued
+    enum class EventMode { Direct, Task, Polling };
+    volatile EventMode eventMode = EventMode::Direct;
+    TotemLib::MessageQueue *eventQueue = nullptr;
+    TaskHandle_t volatile eventTask = nullptr;
 public:
     TotemBLEModule() :
     canService(client, *this),
     totemBUS(memory, this, onTotemBUSCANSend, onTotemBUSMessageReceive) {
+        pendingMutex = xSemaphoreCreateMutex();
         client = BLEDevice::createClient();
         client->setClientCallbacks(this);
+        totemBUS.setCANSendBatch(onTotemBUSCANSendBatch);
+        totemBUS.setCapabilities(TotemBUSProtocol::Capability::CompactValue | TotemBUSProtocol::Capability::WriteBatch
+            | TotemBUSProtocol::Capability::PackedStreamV2 | TotemBUSProtocol::Capability::NativeFraming);
     }
 
     void addOnConnectionChange(void (*onConnectionChange)()) {
@@ -64,6 +111,32 @@ public:
         onStringClbkArg = onString;
         onStringArg = arg;
     }
+    // Strings larger than receive buffer are passed in parts as they arrive
+    void addOnStringChunk(void (*onStringChunk)(int id, const char *data, int len, int offset, int total)) {
+        onStringChunkClbk = onStringChunk;
+        totemBUS.setStringChunkReceiver(onTotemBUSStringChunk);
+    }
+    void addOnStringChunkArg(void (*onStringChunk)(int id, const char *data, int len, int offset, int total, void *arg), void *arg) {
+        onStringChunkClbkArg = onStringChunk;
+        onStringChunkArg = arg;
+        totemBUS.setStringChunkReceiver(onTotemBUSStringChunk);
+    }
+    // Call value and string callbacks from own task. [0] from BLE receive context
+    void setEventTask(int priority) {
+        setEventMode(priority > 0 ? EventMode::Task : EventMode::Direct, priority);
+    }
+    // Call value and string callbacks from pollEvents()
+    void setEventPolling(bool enable) {
+        setEventMode(enable ? EventMode::Polling : EventMode::Direct);
+    }
+    int pollEvents(int max = -1) {
+        if (eventMode != EventMode::Polling) return 0;
+        return eventQueue->poll([this](TotemBUS::Message &message, uint32_t tag) { callEvent(message); }, max);
+    }
+    // Events not passed to callbacks because queue was full
+    uint32_t getDroppedEvents() {
+        return eventQueue ? eventQueue->getDropped() : 0;
+    }
 
     bool connectName(int boardID, const char *name) {
         if (isConnected()) return true;
@@ -90,16 +163,24 @@ public:
     String getAddress() { return String(bleAddress.toString().c_str()); }
 
     int cmdReadValue(uint32_t cmd) {
-        return waitReadValue(cmd, TotemBUS::read(cmd));
+        return waitReadValue(cmd, false);
     }
     String cmdReadString(uint32_t cmd) {
-        return waitReadString(cmd, TotemBUS::read(cmd));
+        return waitReadString(cmd, false);
     }
     int cmdRequestValue(uint32_t cmd) {
-        return waitReadValue(cmd, TotemBUS::requestValue(cmd));
+        return waitReadValue(cmd, true);
     }
     String cmdRequestString(uint32_t cmd) {
-        return waitReadString(cmd, TotemBUS::requestString(cmd));
+        return waitReadString(cmd, true);
+    }
+    // Pipelined reads: all requests are sent in single write and responses
+    // collected within one round trip. Missing values are set to 0
+    bool cmdReadValues(const uint32_t *cmds, int *values, int count) {
+        return waitReadValues(cmds, values, count, false);
+    }
+    bool cmdRequestValues(const uint32_t *cmds, int *values, int count) {
+        return waitReadValues(cmds, values, count, true);
     }
     bool cmdSendValue(uint32_t cmd, int value) {
         if (!isConnected()) return false;
@@ -115,7 +196,33 @@ public:
     }
     bool cmdWrite(uint32_t cmd, int value) {
         if (!isConnected()) return false;
-        return networkSend(TotemBUS::write(cmd, (int32_t)value));
+        if (batching) {
+            if (batch.add(cmd, value)) return true;
+            flushBatch();
+            return batch.add(cmd, value);
+        }
+        TotemBUS::Frame frame = TotemBUS::write(cmd, (int32_t)value);
+        frame.deadline = writeDeadline;
+        return networkSend(frame);
+    }
+    // Value writes not sent within deadline (ms) are dropped. [0] no limit
+    void setWriteDeadline(uint16_t deadline) {
+        writeDeadline = deadline;
+    }
+    uint32_t getExpiredCount() {
+        return canService.getExpiredCount();
+    }
+    uint32_t getDroppedCount() {
+        return canService.getDroppedCount();
+    }
+    // Collect value writes into single message until sendBatch()
+    void beginBatch() {
+        batch.clear();
+        batching = true;
+    }
+    bool sendBatch() {
+        batching = false;
+        return flushBatch();
     }
     bool cmdWrite(uint32_t cmd, const char *str, int len = -1) {
         if (!isConnected()) return false;
@@ -138,34 +245,245 @@ public:
         return cmdWrite(TotemBUS::hash(cmd), str, len);
     }
 private:
-    int waitReadValue(uint32_t cmd, TotemBUS::Frame frame) {
-        if (!isConnected()) return 0;
-        xTaskCommand = cmd;
-        xTaskUser = xTaskGetCurrentTaskHandle();
-        if (!networkSend(frame)) {
-            xTaskUser = nullptr;
-            return 0;
-        }
-        uint32_t result = 0;
-        if (xTaskNotifyWait(ULONG_MAX, 0, &result, pdMS_TO_TICKS(200)) == pdFALSE) return 0;
-        return result;
+    void setEventMode(EventMode mode, int priority = 1) {
+        if (mode == EventMode::Task && eventTask != nullptr) {
+            vTaskPrioritySet(eventTask, priority);
+            return;
+        }
+        // Events still queued are called before switching
+        if (eventMode == EventMode::Polling) {
+            eventMode = EventMode::Direct;
+            eventQueue->poll([this](TotemBUS::Message &message, uint32_t tag) { callEvent(message); });
+        }
+        eventMode = EventMode::Direct;
+        while (eventTask != nullptr) vTaskDelay(pdMS_TO_TICKS(10));
+        if (mode == EventMode::Direct) return;
+        if (eventQueue == nullptr) eventQueue = new TotemLib::StaticMessageQueue<TOTEMBLE_EVENT_QUEUE_SIZE>();
+        eventMode = mode;
+        if (mode != EventMode::Task) return;
+        TaskHandle_t task;
+        if (xTaskCreate(eventsTask, "ble_events", 4096, this, priority, &task) != pdPASS) {
+            eventMode = EventMode::Direct;
+            return;
+        }
+        eventTask = task;
+    }
+    static void eventsTask(void *context) {
+        TotemBLEModule *module = static_cast<TotemBLEModule*>(context);
+        auto call = [module](TotemBUS::Message &message, uint32_t tag) { module->callEvent(message); };
+        while (module->eventMode == EventMode::Task) {
+            if (module->eventQueue->wait(250)) module->eventQueue->poll(call);
+        }
+        module->eventQueue->poll(call);
+        module->eventTask = nullptr;
+        vTaskDelete(nullptr);
+    }
+    void callEvent(TotemBUS::Message &message) {
+        if (message.type == TotemBUS::MessageType::ResponseValue) {
+            if (onValueClbk) onValueClbk(message.command, message.value);
+            if (onValueClbkArg) onValueClbkArg(message.command, message.value, onValueArg);
+        }
+        else {
+            if (onStringClbk) onStringClbk(message.command, String(message.string.data, message.string.length));
+            if (onStringClbkArg) onStringClbkArg(message.command, String(message.string.data, message.string.length), onStringArg);
+        }
+    }
+    int waitReadValue(uint32_t cmd, bool isRequest) {
+        int value = 0;
+        waitReadValues(&cmd, &value, 1, isRequest);
+        return value;
     }
-    String waitReadString(uint32_t cmd, TotemBUS::Frame frame) {
+    String waitReadString(uint32_t cmd, bool isRequest) {
         if (!isConnected()) return String("");
-        xTaskCommand = cmd;
-        xTaskUser = xTaskGetCurrentTaskHandle();
-        if (!networkSend(frame)) {
-            xTaskUser = nullptr;
+        bool leader;
+        int slot = addPendingRead(cmd, true, isRequest, leader);
+        if (slot < 0) return String("");
+        if (leader && !networkSend(isRequest ? TotemBUS::requestString(cmd) : TotemBUS::read(cmd))) {
+            failPendingRead(slot);
+            removePendingRead(slot);
             return String("");
         }
-        const char *str = nullptr;
-        if (xTaskNotifyWait(ULONG_MAX, 0, (uint32_t*)&str, pdMS_TO_TICKS(200)) == pdFALSE) return String("");
-        if (str == nullptr) return String("");
-        return String(str);
+        waitPendingReads(&slot, 1);
+        String result = pendingReads[slot].string;
+        removePendingRead(slot);
+        return result;
+    }
+    bool waitReadValues(const uint32_t *cmds, int *values, int count, bool isRequest) {
+        int slots[TOTEMBLE_PENDING_READS];
+        for (int i=0; i<count; i++) values[i] = 0;
+        if (!isConnected() || count > TOTEMBLE_PENDING_READS) return false;
+        int sent = 0;
+        canService.cork();
+        for (; sent<count; sent++) {
+            bool leader;
+            slots[sent] = addPendingRead(cmds[sent], false, isRequest, leader);
+            if (slots[sent] < 0) break;
+            // Read of same command is already on the air
+            if (!leader) continue;
+            if (!networkSend(isRequest ? TotemBUS::requestValue(cmds[sent]) : TotemBUS::read(cmds[sent]))) {
+                failPendingRead(slots[sent]);
+                removePendingRead(slots[sent]);
+                break;
+            }
+        }
+        canService.uncork();
+        bool result = waitPendingReads(slots, sent) && sent == count;
+        for (int i=0; i<sent; i++) {
+            values[i] = pendingReads[slots[i]].value;
+            removePendingRead(slots[i]);
+        }
+        return result;
+    }
+    // Slot of timed out request still waiting for late response
+    static bool isExpired(const PendingRead &read, TickType_t now) {
+        return read.task == nullptr && read.expired
+            && (now - read.expiredTime) < pdMS_TO_TICKS(TOTEMBLE_LATE_RESPONSE_MS);
+    }
+    // Take slot for read. leader is set if request has to be sent, otherwise
+    // slot joins request of same command and kind already in flight.
+    // Oldest expired slot is taken if none is free
+    int addPendingRead(uint32_t cmd, bool isString, bool isRequest, bool &leader) {
+        int slot = -1, joined = -1, evicted = -1;
+        xSemaphoreTake(pendingMutex, portMAX_DELAY);
+        TickType_t now = xTaskGetTickCount();
+        for (int i=0; i<TOTEMBLE_PENDING_READS; i++) {
+            PendingRead &read = pendingReads[i];
+            if (read.task == nullptr) {
+                if (!isExpired(read, now)) {
+                    if (slot < 0) slot = i;
+                }
+                else if (evicted < 0 || (int32_t)(read.sequence - pendingReads[evicted].sequence) < 0) evicted = i;
+                continue;
+            }
+            if (read.done || read.command != cmd || read.isString != isString || read.isRequest != isRequest) continue;
+            // Join latest request
+            if (joined < 0 || (int32_t)(read.request - pendingReads[joined].request) > 0) joined = i;
+        }
+        if (slot < 0) slot = evicted;
+        if (slot >= 0) {
+            PendingRead &read = pendingReads[slot];
+            read.task = xTaskGetCurrentTaskHandle();
+            read.waiter = pendingSignal.prepare();
+            read.command = cmd;
+            read.sequence = pendingSequence++;
+            read.request = (joined < 0) ? read.sequence : pendingReads[joined].request;
+            read.isString = isString;
+            read.isRequest = isRequest;
+            read.done = false;
+            read.failed = false;
+            read.skipped = (joined >= 0) && pendingReads[joined].skipped;
+            read.expired = false;
+            read.value = 0;
+            read.string = String();
+        }
+        leader = (joined < 0);
+        xSemaphoreGive(pendingMutex);
+        return slot;
+    }
+    // Request of slot was not sent. Wake reads that joined it
+    void failPendingRead(int slot) {
+        xSemaphoreTake(pendingMutex, portMAX_DELAY);
+        uint32_t request = pendingReads[slot].request;
+        for (auto &read : pendingReads) {
+            if (read.task == nullptr || read.done || read.request != request) continue;
+            read.done = true;
+            read.failed = true;
+            pendingSignal.notify(read.waiter);
+        }
+        xSemaphoreGive(pendingMutex);
+    }
+    // Free slot. Request left without response and without other reads
+    // waiting for it is kept expired, so its late response is dropped
+    void removePendingRead(int slot) {
+        xSemaphoreTake(pendingMutex, portMAX_DELAY);
+        PendingRead &removed = pendingReads[slot];
+        removed.task = nullptr;
+        removed.string = String();
+        removed.expired = !removed.done && !removed.skipped;
+        for (auto &read : pendingReads) {
+            if (read.task != nullptr && !read.done && read.request == removed.request) removed.expired = false;
+        }
+        removed.expiredTime = xTaskGetTickCount();
+        xSemaphoreGive(pendingMutex);
+    }
+    // Block until all slots received response or 200ms passed
+    bool waitPendingReads(const int *slots, int count) {
+        uint32_t start = millis();
+        const int timeout = 200;
+        while (true) {
+            TotemLib::ResponseSignal::Waiter waiter = pendingSignal.prepare();
+            bool done = true;
+            bool failed = false;
+            xSemaphoreTake(pendingMutex, portMAX_DELAY);
+            for (int i=0; i<count; i++) {
+                done = done && pendingReads[slots[i]].done;
+                failed = failed || pendingReads[slots[i]].failed;
+            }
+            xSemaphoreGive(pendingMutex);
+            if (done) return !failed;
+            int elapsed = millis() - start;
+            if (elapsed >= timeout) return false;
+            // Woken on each response for this task
+            pendingSignal.wait(waiter, timeout - elapsed);
+        }
+    }
+    // Oldest request waiting for response of command and type. [-1] none
+    int findPendingRead(uint32_t cmd, bool isString, bool withExpired) {
+        int oldest = -1;
+        TickType_t now = xTaskGetTickCount();
+        for (int i=0; i<TOTEMBLE_PENDING_READS; i++) {
+            PendingRead &read = pendingReads[i];
+            bool waiting = (read.task != nullptr && !read.done) || (withExpired && isExpired(read, now));
+            if (!waiting || read.command != cmd || read.isString != isString) continue;
+            if (oldest < 0 || (int32_t)(read.request - pendingReads[oldest].request) < 0) oldest = i;
+        }
+        return oldest;
+    }
+    // Complete oldest pending request of command and all reads sharing it.
+    // Read and request of value respond alike, so these are matched in order
+    // sent. Late response of expired request is dropped. Returns false if not requested
+    bool completePendingRead(TotemBUS::Message &message) {
+        bool isString = message.type == TotemBUS::MessageType::ResponseString;
+        xSemaphoreTake(pendingMutex, portMAX_DELAY);
+        int oldest = findPendingRead(message.command, isString, true);
+        if (oldest >= 0 && pendingReads[oldest].task == nullptr) {
+            pendingReads[oldest].expired = false;
+            // If response was lost instead, next request in line will miss its
+            // own. It does not expire on timeout, so reads do not stay shifted
+            int next = findPendingRead(message.command, isString, false);
+            for (auto &read : pendingReads) {
+                if (next >= 0 && read.task != nullptr && read.request == pendingReads[next].request) read.skipped = true;
+            }
+        }
+        else if (oldest >= 0) {
+            uint32_t request = pendingReads[oldest].request;
+            for (auto &read : pendingReads) {
+                if (read.task == nullptr || read.done || read.request != request) continue;
+                // Copied here. Reader buffer goes back to arena when receive returns
+                if (isString)
+                    read.string = String(message.string.data, message.string.length);
+                else
+                    read.value = message.value;
+                read.done = true;
+                pendingSignal.notify(read.waiter);
+            }
+        }
+        xSemaphoreGive(pendingMutex);
+        return oldest >= 0;
     }
     bool networkSend(TotemBUS::Frame frame) {
+        // Keep order with writes collected before
+        if (batching) flushBatch();
         return frame.send(totemBUS, 0, 0);
     }
+    bool flushBatch() {
+        if (batch.getCount() == 0) return true;
+        TotemBUS::Frame frame = TotemBUS::writeBatch(batch);
+        frame.deadline = writeDeadline;
+        bool result = isConnected() && frame.send(totemBUS, 0, 0);
+        batch.clear();
+        return result;
+    }
     bool establishConnection(BLEAddress address) {
         if (!client->connect(address, BLE_ADDR_TYPE_PUBLIC)) return false;
         if (!canService.initService()) {
@@ -173,30 +491,31 @@ private:
             return false;
         }
         bleAddress = address;
+        // Advertise protocol extensions. Old firmware does not respond
+        totemBUS.negotiate(0, 0);
         return true;
     }
     void onBUSMessageReceive(TotemBUS::Message &message) {
         switch (message.type) {
             case TotemBUS::MessageType::ResponseValue:
-                if (xTaskUser && xTaskCommand == message.command) {
-                    xTaskNotify(xTaskUser, message.value, eSetValueWithOverwrite);
-                    xTaskUser = nullptr;
-                    break;
-                }
-                if (onValueClbk) onValueClbk(message.command, message.value);
-                if (onValueClbkArg) onValueClbkArg(message.command, message.value, onValueArg);
-                break;
             case TotemBUS::MessageType::ResponseString:
-                if (xTaskUser && xTaskCommand == message.command) {
-                    xTaskNotify(xTaskUser, (uint32_t)(message.string.data), eSetValueWithOverwrite);
-                    xTaskUser = nullptr;
-                    break;
-                }
-                if (onStringClbk) onStringClbk(message.command, String(message.string.data, message.string.length));
-                if (onStringClbkArg) onStringClbkArg(message.command, String(message.string.data, message.string.length), onStringArg);
+                if (completePendingRead(message)) break;
+                // Dropped if queue is full
+                if (eventMode != EventMode::Direct) eventQueue->push(message);
+                else callEvent(message);
                 break;
             case TotemBUS::MessageType::ResponseOk:
                 break;
+            case TotemBUS::MessageType::ResponseCapabilities:
+                // Messages are sent to connected board as (0, 0)
+                totemBUS.setPeerCapabilities(0, 0, message.value);
+                // Board supports shorter packet headers
+                if (totemBUS.getPeerCapabilities(0, 0) & TotemBUSProtocol::Capability::PackedStreamV2)
+                    canService.setPackedStreamV2(true);
+                // Board accepts whole messages without CAN packet headers
+                if (totemBUS.getPeerCapabilities(0, 0) & TotemBUSProtocol::Capability::NativeFraming)
+                    nativeFraming = true;
+                break;
             default:
                 return;
         }
@@ -204,24 +523,61 @@ private:
     // TotemBUS request to send CAN packet to physical interface
     static bool onTotemBUSCANSend(void *context, TotemBUSProtocol::CanPacket &packet) {
         // Send requested packet to CAN service
-        static_cast<TotemBLEModule*>(context)->canService.send(packet.id, packet.data, packet.len);
-        return true;
+        return static_cast<TotemBLEModule*>(context)->canService.send(packet.id, packet.data, packet.len);
+    }
+    static bool onTotemBUSCANSendBatch(void *context, TotemBUS::PacketBatch &batch) {
+        TotemBLEModule *module = static_cast<TotemBLEModule*>(context);
+        uint32_t expires = 0;
+        if (batch.deadline) expires = (millis() + batch.deadline) | 1;
+        if (module->nativeFraming && !TotemBUSProtocol::Reader::isRTRCAN(batch.packets[0].id)
+        && batch.count <= TOTEMBUS_BATCH_FRAMES) {
+            uint8_t data[TOTEMBUS_BATCH_FRAMES*8];
+            uint16_t len = 0;
+            for (size_t i=0; i<batch.count; i++) {
+                memcpy(&data[len], batch.packets[i].data, batch.packets[i].len);
+                len += batch.packets[i].len;
+            }
+            if (module->canService.sendMessage(batch.packets[0].id, data, len, expires)) return true;
+        }
+        // Send all packets of message in single BLE write
+        bool result = true;
+        module->canService.cork();
+        for (size_t i=0; i<batch.count; i++) {
+            if (!module->canService.send(batch.packets[i].id, batch.packets[i].data, batch.packets[i].len, false, expires))
+                result = false;
+        }
+        module->canService.uncork();
+        return result;
     }
     static bool onTotemBUSMessageReceive(void *context, TotemBUS::Message message) {
         static_cast<TotemBLEModule*>(context)->onBUSMessageReceive(message);
         return true;
     }
+    static bool onTotemBUSStringChunk(void *context, TotemBUS::Message message, uint32_t offset, uint32_t total) {
+        TotemBLEModule *module = static_cast<TotemBLEModule*>(context);
+        if (message.type != TotemBUS::MessageType::ResponseString) return true;
+        if (module->onStringChunkClbk)
+            module->onStringChunkClbk(message.command, message.string.data, message.string.length, offset, total);
+        if (module->onStringChunkClbkArg)
+            module->onStringChunkClbkArg(message.command, message.string.data, message.string.length, offset, total, module->onStringChunkArg);
+        return true;
+    }
     // Received CAN packet from BLE CAN service
     void onServiceReceive(uint32_t id, uint8_t *data, uint8_t len) override {
         // Pass received CAN packet to TotemBUS for processing
         totemBUS.processCAN(id, data, len);
     }
+    void onServiceReceiveMessage(uint32_t id, uint8_t *data, uint16_t len) override {
+        totemBUS.processMessage(id, data, len);
+    }
     // BLEClient connection event
     void onConnect(BLEClient *pClient) override {
         if (onConnectionChangeClbk) onConnectionChangeClbk();
         if (onConnectionChangeClbkArg) onConnectionChangeClbkArg(onConnectionChangeArg);
     }
     void onDisconnect(BLEClient *pClient) override {
+        canService.setPackedStreamV2(false);
+        nativeFraming = false;
         if (onConnectionChangeClbk) onConnectionChangeClbk();
         if (onConnectionChangeClbkArg) onConnectionChangeClbkArg(onConnectionChangeArg);
     }